@@ -1,700 +1,866 @@
 ﻿// Algorithm.cpp
 #include "Algorithm.h"
+#include "OptimizedBoard.h"
+#include "Profiler.h"
 #include <omp.h>
 #include <execution>
 #include <thread>
 #include <mutex>
 #include <algorithm>
+#include <numeric>
 #include <atomic>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <unordered_map>
 
 
 namespace Algorithm {
 
-	class OptimizedBoard {
-	private:
-		// <summary>
-		// 盤面の1次元表現
-		// - `grid` : 現在の盤面データ
-		// - `goal` : ゴール盤面データ
-		// - `temp_grid` : 一時データ用
-		// </summary>
-		std::vector<uint64_t> grid;
-		std::vector<uint64_t> goal;
-		std::vector<uint64_t> temp_grid;
-
-		// 64bitに2bitごとに入れるので64/2 = 32bit
-		static constexpr int CELLS_PER_UINT64 = 32;
-
-		// 2bitごとに1次元に直すので"11"でandをとる
-		static constexpr uint64_t MASK = 0x3; // 11 in binary
-
-		// 座標変換
-		int calculateIndex(int x, int y) const {
-			return y * width + x;
-		}
-
-		// ポップカウント
-		int popcount(int n) const {
-			// return std::popcount(static_cast<unsigned>(n));
-			return std::popcount(static_cast<uint32_t>(n));
-			// return __builtin_popcount(n);
-		}
+	// 1手を盤面に適用
+	void applyMove(OptimizedBoard& board, const Array<Pattern>& patterns, const Move& move) {
+		board.apply_pattern(patterns[move.patternIndex], move.pos, move.direction);
+	}
 
-		// Y座標変換
-		int getYFromIndex(int index) const {
-			return index / width;
+	// 探索用の手順を提出用の `Solution` に変換
+	Solution toSolution(const Array<Move>& moves, const Array<Pattern>& patterns) {
+		Solution solution;
+		solution.steps.reserve(moves.size());
+		for (const auto& [patternIndex, pos, direction] : moves) {
+			solution.steps.emplace_back(patterns[patternIndex], pos, direction);
 		}
+		return solution;
+	}
 
+	// 行ごとのローリングハッシュによる区間の索引
+	// ゴールの「次の k マス」が現在の盤面のどの行のどこから連続して現れるかを、k の二分探索で答える
+	// 盤面のコピーを軽く保つため盤面の外で持ち、変更のあった行だけ sync() で作り直す
+	// 2^64 を法とするハッシュなので衝突はありうるが、候補の順位付けにしか使わない
+	class SegmentIndex {
 	public:
-		// サイズ
-		int width, height;
+		// 盤面全体から作り直す
+		void rebuild(OptimizedBoard& board) {
+			m_width = board.width;
+			m_height = board.height;
+
+			m_power.resize(2 * m_width + 1);
+			m_power[0] = 1;
+			for (int i = 1; i <= 2 * m_width; ++i) m_power[i] = m_power[i - 1] * Base;
+
+			m_goalPrefix.resize(static_cast<size_t>(m_height) * (m_width + 1));
+			for (int y = 0; y < m_height; ++y) {
+				uint64_t* prefix = &m_goalPrefix[static_cast<size_t>(y) * (m_width + 1)];
+				prefix[0] = 0;
+				for (int x = 0; x < m_width; ++x) prefix[x + 1] = prefix[x] * Base + board.getGoal(x, y) + 1;
+			}
 
-		// 初期化
-		OptimizedBoard(int w, int h) : width(w), height(h) {
-			int cellCount = width * height;
-			int uint64Count = (cellCount + CELLS_PER_UINT64 - 1) / CELLS_PER_UINT64;
-			grid.resize(uint64Count, 0);
-			goal.resize(uint64Count, 0);
-			temp_grid.resize(uint64Count, 0);
+			m_gridPrefix.resize(static_cast<size_t>(m_height) * (2 * m_width + 1));
+			for (int y = 0; y < m_height; ++y) rebuildRow(board, y);
+			board.takeDirtyRows();
+			m_goal = board.packedGoal();
 		}
 
-		OptimizedBoard(int w, int h, const Grid<int>& gr, const Grid<int>& go) :width(w), height(h) {
-			int cellCount = width * height;
-			int uint64Count = (cellCount + CELLS_PER_UINT64 - 1) / CELLS_PER_UINT64;
-			grid.resize(uint64Count, 0);
-			goal.resize(uint64Count, 0);
-			temp_grid.resize(uint64Count, 0);
-			setGrid(gr);
-			setGoal(go);
+		// board を引けるようにする
+		// 大きさとゴールが前回と同じなら、前回から変わった行だけを作り直す
+		// （同じ盤面を使い続けるか、前回の盤面との違いがすべて dirty になっている盤面を渡すこと）
+		void prepare(OptimizedBoard& board) {
+			if (board.width != m_width || board.height != m_height || board.packedGoal() != m_goal) {
+				rebuild(board);
+			}
+			else {
+				sync(board);
+			}
 		}
 
-		// 1行だけのボード
-		OptimizedBoard(int w, const std::vector<uint64_t>& gr, const std::vector<uint64_t>& go) :width(w), height(1) {
-			int cellCount = width * height;
-			int uint64Count = (cellCount + CELLS_PER_UINT64 - 1) / CELLS_PER_UINT64;
-			grid.resize(uint64Count, 0);
-			goal.resize(uint64Count, 0);
-			temp_grid.resize(uint64Count, 0);
-			grid = gr;
-			goal = go;
+		// 前回から変わった行だけ作り直す
+		void sync(OptimizedBoard& board) {
+			const auto [top, bottom] = board.takeDirtyRows();
+			for (int y = top; y <= bottom; ++y) rebuildRow(board, y);
 		}
 
-		// 比較関数
-		bool operator==(const OptimizedBoard& other) const { return grid == other.grid; };
-
-		// 現在の盤面の個々の値を設定
-		void set(int x, int y, int value) {
-			int index = y * width + x;
-			int arrayIndex = index / CELLS_PER_UINT64;
-			int bitIndex = (index % CELLS_PER_UINT64) * 2;
-
-			uint64_t clearMask = ~(MASK << bitIndex);
-			grid[arrayIndex] = (grid[arrayIndex] & clearMask) |
-				(static_cast<uint64_t>(value) << bitIndex);
+		// ゴールの (gx, gy) から行末までと、現在の y 行目の x から（行の先頭に回り込んで）何マス一致するか
+		int32 commonExtension(int gx, int gy, int x, int y) const {
+			int lo = 0, hi = m_width - gx;
+			while (lo < hi) {
+				const int mid = (lo + hi + 1) / 2;
+				if (goalHash(gx, gy, mid) == gridHash(x, y, mid)) lo = mid;
+				else hi = mid - 1;
+			}
+			return lo;
 		}
 
-		// ゴール盤面の個々の値を設定
-		void _set(int x, int y, int value) {
-			int index = y * width + x;
-			int arrayIndex = index / CELLS_PER_UINT64;
-			int bitIndex = (index % CELLS_PER_UINT64) * 2;
-
-			uint64_t clearMask = ~(MASK << bitIndex);
-			goal[arrayIndex] = (goal[arrayIndex] & clearMask) |
-				(static_cast<uint64_t>(value) << bitIndex);
+	private:
+		static constexpr uint64_t Base = 0x9E3779B97F4A7C15ULL;
+
+		int m_width = 0;
+		int m_height = 0;
+		std::vector<uint64_t> m_power;
+		// 行ごとの接頭辞ハッシュ（現在の盤面は回り込みのため行を2周分持つ）
+		std::vector<uint64_t> m_goalPrefix;
+		std::vector<uint64_t> m_gridPrefix;
+		// 索引を作ったゴール
+		std::vector<uint64_t> m_goal;
+
+		void rebuildRow(const OptimizedBoard& board, int y) {
+			uint64_t* prefix = &m_gridPrefix[static_cast<size_t>(y) * (2 * m_width + 1)];
+			prefix[0] = 0;
+			for (int i = 0; i < 2 * m_width; ++i) {
+				prefix[i + 1] = prefix[i] * Base + board.getGrid(i % m_width, y) + 1;
+			}
 		}
 
-		// 現在の盤面上の値を取得
-		int getGrid(int x, int y) const {
-			if (x >= width || y >= height)return -1;
-			int index = y * width + x;
-			int arrayIndex = index / CELLS_PER_UINT64;
-			int bitIndex = (index % CELLS_PER_UINT64) * 2;
-
-			return (grid[arrayIndex] >> bitIndex) & MASK;
+		uint64_t goalHash(int x, int y, int length) const {
+			const uint64_t* prefix = &m_goalPrefix[static_cast<size_t>(y) * (m_width + 1)];
+			return prefix[x + length] - prefix[x] * m_power[length];
 		}
 
-		// ゴール盤面上の値を取得
-		int getGoal(int x, int y) const {
-			if (x >= width || y >= height)return -1;
-			int index = y * width + x;
-			int arrayIndex = index / CELLS_PER_UINT64;
-			int bitIndex = (index % CELLS_PER_UINT64) * 2;
-
-			return (goal[arrayIndex] >> bitIndex) & MASK;
+		uint64_t gridHash(int x, int y, int length) const {
+			const uint64_t* prefix = &m_gridPrefix[static_cast<size_t>(y) * (2 * m_width + 1)];
+			return prefix[x + length] - prefix[x] * m_power[length];
 		}
+	};
 
-		// グリッドを一度に設定
-		void setGrid(const Grid<int>& grid) {
-			for (int i : step(grid.height())) {
-				for (int j : step(grid.width())) {
-					set(j, i, grid[i][j]);
+	// 行どうしの一致数の表
+	// similarity(i, j) = 現在の盤面の i 行目とゴールの j 行目で値が一致するマスの数
+	// 値ごとの出現ビットマスクの AND を popcount するので、1組あたり 4 * rowWords 回で済む
+	class RowSimilarity {
+	public:
+		explicit RowSimilarity(const OptimizedBoard& board)
+			: m_height(board.height) {
+			const int words = board.rowMaskWords();
+
+			// ゴール側の出現ビットマスク
+			std::vector<uint64_t> goalMask(static_cast<size_t>(board.height) * 4 * words, 0);
+			for (int y = 0; y < board.height; ++y) {
+				for (int x = 0; x < board.width; ++x) {
+					goalMask[(static_cast<size_t>(y) * 4 + board.getGoal(x, y)) * words + x / 64] |= 1ULL << (x % 64);
 				}
 			}
-		}
 
-		// ゴールを一度に設定
-		void setGoal(const Grid<int>& goal) {
-			for (int i : step(goal.height())) {
-				for (int j : step(goal.width())) {
-					_set(j, i, goal[i][j]);
+			m_similarity.assign(static_cast<size_t>(board.height) * board.height, 0);
+			for (int i = 0; i < board.height; ++i) {
+				for (int j = 0; j < board.height; ++j) {
+					int32 count = 0;
+					for (int v = 0; v < 4; ++v) {
+						const uint64_t* current = board.getValueMask(i, v);
+						const uint64_t* target = &goalMask[(static_cast<size_t>(j) * 4 + v) * words];
+						for (int w = 0; w < words; ++w) {
+							count += std::popcount(current[w] & target[w]);
+						}
+					}
+					m_similarity[static_cast<size_t>(i) * board.height + j] = count;
 				}
 			}
 		}
 
-		// コンソールデバッグ用
-		void print() {
-			Grid<int> grid(width, height), goal(width, height);
-			for (int i = 0; i < height; i++) {
-				for (int j = 0; j < width; j++) {
-					// std::cout << getGrid(j, i) << " ";
-					grid[i][j] = getGrid(j, i);
-					goal[i][j] = getGoal(j, i);
-				}
-			}
-			Console << U"grid\n" << grid;
-			Console << U"goal\n" << goal;
-
-		}
-
-		// 上向き適用
-		void shift_up(const std::vector<bool>& isRemoved) {
-			std::fill(temp_grid.begin(), temp_grid.end(), 0);
-			for (int x = 0; x < width; ++x) {
-				int writeY = 0;
-				for (int y = 0; y < height; ++y) {
-					if (!isRemoved[y * width + x]) {
-						int value = getGrid(x, y);
-						int writeIndex = writeY * width + x;
-						int writeArrayIndex = writeIndex / CELLS_PER_UINT64;
-						int writeBitIndex = (writeIndex % CELLS_PER_UINT64) * 2;
-						temp_grid[writeArrayIndex] |= static_cast<uint64_t>(value) << writeBitIndex;
-						++writeY;
+		int32 operator()(int i, int j) const {
+			return m_similarity[static_cast<size_t>(i) * m_height + j];
+		}
+
+		// 一致数の合計が最大になる割り当て（ハンガリアン法, O(H^3)）
+		// 戻り値[j] = ゴールの j 行目に持ってくる現在の行
+		Array<int32> assign() const {
+			const int n = m_height;
+			const int32 INF = std::numeric_limits<int32>::max() / 2;
+			// 1-indexed の作業配列（0 は番兵）
+			std::vector<int32> u(n + 1, 0), v(n + 1, 0), way(n + 1, 0), minv(n + 1);
+			std::vector<int32> matchedRow(n + 1, 0);
+			std::vector<char> used(n + 1);
+
+			for (int i = 1; i <= n; ++i) {
+				matchedRow[0] = i;
+				int j0 = 0;
+				std::fill(minv.begin(), minv.end(), INF);
+				std::fill(used.begin(), used.end(), 0);
+				do {
+					used[j0] = 1;
+					const int i0 = matchedRow[j0];
+					int32 delta = INF;
+					int j1 = 0;
+					for (int j = 1; j <= n; ++j) {
+						if (used[j]) continue;
+						// 一致数の最大化をコストの最小化に直す
+						const int32 cost = -(*this)(i0 - 1, j - 1) - u[i0] - v[j];
+						if (cost < minv[j]) {
+							minv[j] = cost;
+							way[j] = j0;
+						}
+						if (minv[j] < delta) {
+							delta = minv[j];
+							j1 = j;
+						}
 					}
-				}
-				for (int y = 0; y < height; ++y) {
-					if (isRemoved[y * width + x]) {
-						int value = getGrid(x, y);
-						int writeIndex = writeY * width + x;
-						int writeArrayIndex = writeIndex / CELLS_PER_UINT64;
-						int writeBitIndex = (writeIndex % CELLS_PER_UINT64) * 2;
-						temp_grid[writeArrayIndex] |= static_cast<uint64_t>(value) << writeBitIndex;
-						++writeY;
+					for (int j = 0; j <= n; ++j) {
+						if (used[j]) {
+							u[matchedRow[j]] += delta;
+							v[j] -= delta;
+						}
+						else {
+							minv[j] -= delta;
+						}
 					}
-				}
+					j0 = j1;
+				} while (matchedRow[j0] != 0);
+				do {
+					const int j1 = way[j0];
+					matchedRow[j0] = matchedRow[j1];
+					j0 = j1;
+				} while (j0 != 0);
 			}
-			std::swap(grid, temp_grid);
-		}
-
-		// 下向き適用
-		void shift_down(const std::vector<bool>& isRemoved) {
-			std::fill(temp_grid.begin(), temp_grid.end(), 0);
-			for (int x = 0; x < width; ++x) {
-				int writeY = height - 1;
-				for (int y = height - 1; y >= 0; --y) {
-					if (!isRemoved[y * width + x]) {
-						int value = getGrid(x, y);
-						int writeIndex = writeY * width + x;
-						int writeArrayIndex = writeIndex / CELLS_PER_UINT64;
-						int writeBitIndex = (writeIndex % CELLS_PER_UINT64) * 2;
-						temp_grid[writeArrayIndex] |= static_cast<uint64_t>(value) << writeBitIndex;
-						--writeY;
-					}
-				}
-				for (int y = height - 1; y >= 0; --y) {
-					if (isRemoved[y * width + x]) {
-						int value = getGrid(x, y);
-						int writeIndex = writeY * width + x;
-						int writeArrayIndex = writeIndex / CELLS_PER_UINT64;
-						int writeBitIndex = (writeIndex % CELLS_PER_UINT64) * 2;
-						temp_grid[writeArrayIndex] |= static_cast<uint64_t>(value) << writeBitIndex;
-						--writeY;
-					}
-				}
+
+			Array<int32> assignment(n);
+			for (int j = 1; j <= n; ++j) {
+				assignment[j - 1] = matchedRow[j] - 1;
 			}
-			std::swap(grid, temp_grid);
+			return assignment;
 		}
 
-		// 左向き適用
-		void shift_left(const std::vector<bool>& isRemoved) {
-			std::fill(temp_grid.begin(), temp_grid.end(), 0);
+	private:
+		int32 m_height;
+		std::vector<int32> m_similarity;
+	};
+
+	// 行単位の並べ替えの事前処理
+	// 全幅を同じ型で敷き詰めて上に寄せると、y 行目以降の行は崩れずに丸ごと並べ替わる
+	// 割り当てに従ってゴールの上の行から順に、見合う行だけを持ってくる
+	class RowPlacement {
+	public:
+		// 1マス揃えるのに貪欲がかける手数の目安（これより安く行を持ってこられるときだけ動かす）
+		static constexpr double StepsPerCell = 0.5;
+
+		// board を進め、使った手を moves の末尾に追加する
+		static void apply(OptimizedBoard& board, const Array<Pattern>& patterns, Array<Move>& moves) {
+			const int width = board.width;
+			const int height = board.height;
+			const RowSimilarity similarity(board);
+			const Array<int32> assignment = similarity.assign();
+
+			// rowAt[p] = 今 p 行目にある元の行
+			Array<int32> rowAt(height), nextRowAt(height);
+			for (int y = 0; y < height; ++y) rowAt[y] = y;
+
+			int placedRows = 0;
+			const size_t firstStep = moves.size();
 			for (int y = 0; y < height; ++y) {
-				int writeX = 0;
-				for (int x = 0; x < width; ++x) {
-					if (!isRemoved[y * width + x]) {
-						int value = getGrid(x, y);
-						int writeIndex = y * width + writeX;
-						int writeArrayIndex = writeIndex / CELLS_PER_UINT64;
-						int writeBitIndex = (writeIndex % CELLS_PER_UINT64) * 2;
-						temp_grid[writeArrayIndex] |= static_cast<uint64_t>(value) << writeBitIndex;
-						++writeX;
-					}
-				}
-				for (int x = 0; x < width; ++x) {
-					if (isRemoved[y * width + x]) {
-						int value = getGrid(x, y);
-						int writeIndex = y * width + writeX;
-						int writeArrayIndex = writeIndex / CELLS_PER_UINT64;
-						int writeBitIndex = (writeIndex % CELLS_PER_UINT64) * 2;
-						temp_grid[writeArrayIndex] |= static_cast<uint64_t>(value) << writeBitIndex;
-						++writeX;
+				const int row = assignment[y];
+				const int position = static_cast<int>(std::find(rowAt.begin() + y, rowAt.end(), row) - rowAt.begin());
+				const int n = height - y;
+
+				if (position != y) {
+					const Array<BandOperation> plan = planRowMove(width, n, position - y);
+					int32 cost = 0;
+					for (const auto& operation : plan) cost += operation.cost(width);
+					const int32 gain = similarity(row, y) - similarity(rowAt[y], y);
+					if (plan.empty() || gain * StepsPerCell <= cost) break;
+
+					for (const auto& operation : plan) {
+						for (int x = 0; x < width; x += operation.size()) {
+							const Move move{ operation.patternIndex(), Point(x, y), 0 };
+							applyMove(board, patterns, move);
+							moves.push_back(move);
+						}
+						for (int p = 0; p < n; ++p) {
+							nextRowAt[y + operation.map(p, n)] = rowAt[y + p];
+						}
+						std::copy(nextRowAt.begin() + y, nextRowAt.end(), rowAt.begin() + y);
 					}
+					assert(rowAt[y] == row);
+					++placedRows;
 				}
+
+				// 揃っていない行の下は貪欲で崩されるので、そこで止める
+				if (similarity(row, y) < width) break;
 			}
-			std::swap(grid, temp_grid);
+			Console << U"row placement: {} rows / {} steps"_fmt(placedRows, moves.size() - firstStep);
 		}
 
-		// 右向き適用
-		void shift_right(const std::vector<bool>& isRemoved) {
-			std::fill(temp_grid.begin(), temp_grid.end(), 0);
-			for (int y = 0; y < height; ++y) {
-				int writeX = width - 1;
-				for (int x = width - 1; x >= 0; --x) {
-					if (!isRemoved[y * width + x]) {
-						int value = getGrid(x, y);
-						int writeIndex = y * width + writeX;
-						int writeArrayIndex = writeIndex / CELLS_PER_UINT64;
-						int writeBitIndex = (writeIndex % CELLS_PER_UINT64) * 2;
-						temp_grid[writeArrayIndex] |= static_cast<uint64_t>(value) << writeBitIndex;
-						--writeX;
-					}
-				}
-				for (int x = width - 1; x >= 0; --x) {
-					if (isRemoved[y * width + x]) {
-						int value = getGrid(x, y);
-						int writeIndex = y * width + writeX;
-						int writeArrayIndex = writeIndex / CELLS_PER_UINT64;
-						int writeBitIndex = (writeIndex % CELLS_PER_UINT64) * 2;
-						temp_grid[writeArrayIndex] |= static_cast<uint64_t>(value) << writeBitIndex;
-						--writeX;
-					}
+	private:
+		// 幅 size の定型抜き型（タイプⅠ または タイプⅡ）を全幅に敷き詰めて上に寄せる操作
+		struct BandOperation {
+			int32 bit;
+			bool evenRows;
+
+			int32 size() const { return 1 << bit; }
+			int32 patternIndex() const { return powerOfTwoPatternIndex(bit) + (evenRows ? 1 : 0); }
+			int32 cost(int32 width) const { return (width + size() - 1) / size(); }
+
+			// 対象の n 行のうち相対位置 p の行が移る先
+			int32 map(int32 p, int32 n) const {
+				const int32 covered = Min(size(), n);
+				if (!evenRows) {
+					return p < covered ? p + (n - covered) : p - covered;
 				}
+				// 型の中の偶数行が抜けて下へ、残りは詰まる
+				const int32 removedCount = (covered + 1) / 2;
+				if (p >= covered) return p - removedCount;
+				return (p % 2 == 1) ? p / 2 : n - removedCount + p / 2;
 			}
-			std::swap(grid, temp_grid);
-		}
-
-		// 適用
-		void apply_pattern(const Pattern& pattern, Point pos, int direction) {
-			std::vector<bool> isRemovedVector(width * height, 0);
-			for (int y = 0; y < pattern.grid.height(); ++y) {
-				for (int x = 0; x < pattern.grid.width(); ++x) {
-					if (pattern.grid[y][x] == 1) {
-						int bx = pos.x + x, by = pos.y + y;
-						if (0 <= bx && bx < width && 0 <= by && by < height) {
-							isRemovedVector[by * width + bx] = 1;
-						}
+		};
+
+		// 相対位置 from の行を先頭に持ってくる最安の操作列（位置についての最短路）
+		static Array<BandOperation> planRowMove(int width, int n, int from) {
+			Array<BandOperation> operations;
+			for (int bit = 0; bit <= MaxPatternBit; ++bit) {
+				// n 行すべてを覆うタイプⅠは並びを変えない
+				if ((1 << bit) < n) operations.push_back({ bit, false });
+				if (bit >= 1) operations.push_back({ bit, true });
+				if ((1 << bit) >= Max(width, n)) break;
+			}
+
+			const int32 INF = std::numeric_limits<int32>::max();
+			Array<int32> dist(n, INF), parent(n, -1), parentOperation(n, -1);
+			Array<bool> done(n, false);
+			dist[from] = 0;
+			for (int iteration = 0; iteration < n; ++iteration) {
+				int p = -1;
+				for (int i = 0; i < n; ++i) {
+					if (!done[i] && dist[i] != INF && (p == -1 || dist[i] < dist[p])) p = i;
+				}
+				if (p == -1 || p == 0) break;
+				done[p] = true;
+				for (int k = 0; k < static_cast<int>(operations.size()); ++k) {
+					const int next = operations[k].map(p, n);
+					const int32 cost = dist[p] + operations[k].cost(width);
+					if (cost < dist[next]) {
+						dist[next] = cost;
+						parent[next] = p;
+						parentOperation[next] = k;
 					}
 				}
 			}
 
-			switch (direction) {
-			case 0: // up
-				shift_up(isRemovedVector);
-				break;
-			case 1: // down
-				shift_down(isRemovedVector);
-				break;
-			case 2: // left
-				shift_left(isRemovedVector);
-				break;
-			case 3: // right
-				shift_right(isRemovedVector);
-				break;
+			Array<BandOperation> plan;
+			if (dist[0] == INF) return plan;
+			for (int p = 0; p != from; p = parent[p]) {
+				plan.push_back(operations[parentOperation[p]]);
 			}
-
+			std::reverse(plan.begin(), plan.end());
+			return plan;
 		}
+	};
 
-		// 盤面すべての揃っている個数のカウント
-		int getCorrectCountAll() const {
-			int count = 0;
-			for (size_t i = 0; i < grid.size(); ++i) {
-				uint64_t g = grid[i];
-				uint64_t go = goal[i];
-				for (size_t bit = 0; bit < sizeof(uint64_t) * 8; bit += 2) {
-					// Extract 2-bit segments from both grid and goal
-					uint64_t gSegment = (g >> bit) & 0b11;
-					uint64_t goSegment = (go >> bit) & 0b11;
-					// Check if they match
-					if (gSegment == goSegment) {
-						count += 1; // Increment count if the 2-bit segments match
-					}
+	// 抜き型の全位置の一括評価
+	// 横向き（左・右）の手では各行が独立に動くので、盤面の y 行目に抜き型の行の形を x だけずらして置いたときの一致数の増減を求め、
+	// その行を含む置き方すべてに足し込む（盤面のコピーも適用もしない）
+	// - 同じ形の行が等間隔に多く並ぶ（定型抜き型）ときは、増減の表を y 方向に間隔おきに累積して1回の引き算で足す
+	// - 1 の続きが多い形は、行ごとに「ずらし量 k ごとの一致数の累積和」を作って続き1つを O(1) で数える
+	class PlacementScorer {
+	public:
+		// direction は 2: 左, 3: 右（縦向きは転置した盤面で数える）
+		// 結果の [yi][xi] は左上を (xi - (抜き型の幅 - 1), yi - (抜き型の高さ - 1)) に置いたあとの一致数
+		static Grid<int32> horizontal(const OptimizedBoard& board, const Grid<int32>& pattern, int32 direction) {
+			const int32 width = board.width, height = board.height;
+			const int32 patternWidth = static_cast<int32>(pattern.width()), patternHeight = static_cast<int32>(pattern.height());
+			const int32 columns = width + patternWidth - 1, rows = height + patternHeight - 1;
+			const bool left = direction == 2;
+
+			std::vector<int32> base(height);
+			int32 total = 0;
+			for (int32 y = 0; y < height; ++y) {
+				base[y] = board.equalCount(y * width, y * width, width);
+				total += base[y];
+			}
+			Grid<int32> scores(columns, rows, total);
+
+			// 抜き型の行を形ごとにまとめる
+			std::vector<Shape> shapes;
+			for (int32 r = 0; r < patternHeight; ++r) {
+				std::vector<Run> runs;
+				for (int32 x = 0; x < patternWidth;) {
+					if (pattern[r][x] != 1) { ++x; continue; }
+					const int32 begin = x;
+					while (x < patternWidth && pattern[r][x] == 1) ++x;
+					runs.push_back({ begin, x });
 				}
+				if (runs.empty()) continue;
+				const auto it = std::find_if(shapes.begin(), shapes.end(), [&](const Shape& shape) { return shape.runs == runs; });
+				if (it == shapes.end()) shapes.push_back({ std::move(runs), { r }, 1, {} });
+				else it->rows.push_back(r);
 			}
-			return count;
-		}
 
-		// 何マスまで揃っているかのカウント
-		int getCorrectCount() const {
-			int count = 0;
-			int totalCells = width * height;
-			int uint64Count = (totalCells + CELLS_PER_UINT64 - 1) / CELLS_PER_UINT64;
+			bool needsTable = false;
+			for (auto& shape : shapes) {
+				shape.stride = shape.rows.size() > 1 ? shape.rows[1] - shape.rows[0] : 1;
+				bool arithmetic = shape.rows.size() >= MinPrefixRows;
+				for (size_t i = 1; i < shape.rows.size(); ++i) {
+					arithmetic &= shape.rows[i] - shape.rows[i - 1] == shape.stride;
+				}
+				if (arithmetic) shape.delta.assign(static_cast<size_t>(height) * columns, 0);
+				needsTable |= shape.runs.size() > MaxDirectRuns;
+			}
 
+			RowTable table;
+			std::vector<Run> clipped;
+			for (int32 y = 0; y < height; ++y) {
+				if (needsTable) table.build(board, y);
+				for (auto& shape : shapes) {
+					for (int32 xi = 0; xi < columns; ++xi) {
+						const int32 px = xi - (patternWidth - 1);
+						clipped.clear();
+						for (const auto& run : shape.runs) {
+							const int32 begin = Max(0, px + run.begin), end = Min(width, px + run.end);
+							if (begin < end) clipped.push_back({ begin, end });
+						}
+						if (clipped.empty()) continue;
+						const int32 delta = (shape.runs.size() > MaxDirectRuns ? table.rowMatches(clipped, left) : rowMatches(board, y, clipped, left)) - base[y];
 
-			for (int i = 0; i < uint64Count; ++i) {
-				uint64_t diff = grid[i] ^ goal[i];
-				if (diff != 0) {
-					for (int j = 0; j < CELLS_PER_UINT64 && count < totalCells; ++j) {
-						if ((diff & MASK) != 0) {
-							return count;
+						if (!shape.delta.empty()) {
+							shape.delta[static_cast<size_t>(y) * columns + xi] = delta;
+						}
+						else {
+							// 抜き型の r 行目が y 行目に来る置き方すべてに足す
+							for (const int32 r : shape.rows) {
+								scores[y - r + patternHeight - 1][xi] += delta;
+							}
 						}
-						diff >>= 2;
-						count++;
-					}
-				}
-				else {
-					count += CELLS_PER_UINT64;
-					if (count > totalCells) {
-						count = totalCells;
-						break;
 					}
 				}
 			}
-			return count;
-		}
-
-		//　任意の点から何マスまで揃っているか
-		int getCorrectCountFrom(int startX, int startY) const {
-			int count = 0;
-			int totalCells = width * height;
-			int currentIndex = startY * width + startX;
-
-			while (count < totalCells) {
-				int arrayIndex = currentIndex / CELLS_PER_UINT64;
-				int bitIndex = (currentIndex % CELLS_PER_UINT64) * 2;
 
-				uint64_t diff = (grid[arrayIndex] ^ goal[arrayIndex]) >> bitIndex;
-
-				while (bitIndex < 64 && count < totalCells) {
-					if ((diff & MASK) != 0) {
-						return count;
+			for (auto& shape : shapes) {
+				if (shape.delta.empty()) continue;
+				auto& delta = shape.delta;
+				const int32 stride = shape.stride;
+				// 間隔 stride おきの累積和
+				for (int32 y = stride; y < height; ++y) {
+					for (int32 xi = 0; xi < columns; ++xi) {
+						delta[static_cast<size_t>(y) * columns + xi] += delta[static_cast<size_t>(y - stride) * columns + xi];
 					}
-					diff >>= 2;
-					bitIndex += 2;
-					count++;
-					currentIndex++;
-
-					// Wrap around to the beginning if we reach the end
-					if (currentIndex >= totalCells) {
-						currentIndex = 0;
+				}
+				const int32 first = shape.rows.front(), count = static_cast<int32>(shape.rows.size());
+				for (int32 yi = 0; yi < rows; ++yi) {
+					const int32 py = yi - (patternHeight - 1);
+					// 盤面に入る k の範囲 [kBegin, kEnd)
+					const int32 last = height - 1 - (py + first);
+					if (last < 0) continue;
+					const int32 kBegin = Max(0, (-(py + first) + stride - 1) / stride);
+					const int32 kEnd = Min(count, last / stride + 1);
+					if (kBegin >= kEnd) continue;
+					const int32 yFirst = py + first + kBegin * stride, yLast = py + first + (kEnd - 1) * stride;
+					for (int32 xi = 0; xi < columns; ++xi) {
+						int32 sum = delta[static_cast<size_t>(yLast) * columns + xi];
+						if (yFirst - stride >= 0) sum -= delta[static_cast<size_t>(yFirst - stride) * columns + xi];
+						scores[yi][xi] += sum;
 					}
 				}
 			}
-
-			return count;
+			return scores;
 		}
 
-		//　任意の行が何個揃っているか
-		int getCorrectCountByRrow(int row)const {
-			int res = 0;
-			for (int x : step(width)) {
-				res += getGoal(x, row) == getGrid(x, row);
-			}
-			return res;
-		}
+	private:
+		// 累積和で足す形の最小の行数
+		static constexpr size_t MinPrefixRows = 4;
 
-		// 任意のマス(x, y) = (a, b)と同じ値のマスで最も近い点
-		Point findClosestPointWithSameValue(int a, int b) const {
-			int targetValue = getGoal(a, b);
-			int targetIndex = calculateIndex(a, b);
-			std::vector<std::pair<int, int>> candidates;
+		// 続きがこれより多い形は行ごとの累積和の表で数える
+		static constexpr size_t MaxDirectRuns = 4;
 
-			// Step 1 & 2: Find all points with the same value
-			for (int y = b; y < height; ++y) {
-				for (int x = a; x < width; ++x) {
-					if (getGrid(x, y) == targetValue) {
-						candidates.emplace_back(x, y);
+		// 抜き型の1行の 1 の続き [begin, end)
+		struct Run {
+			int32 begin, end;
+			bool operator==(const Run&) const = default;
+		};
+
+		// 抜き型の行の形と、その形の行の番号
+		// 行が等間隔に MinPrefixRows 行以上並ぶなら delta に増減の表を持つ
+		struct Shape {
+			std::vector<Run> runs;
+			std::vector<int32> rows;
+			int32 stride = 1;
+			std::vector<int32> delta;
+		};
+
+		// 1行分の「ずらし量 k ごとの一致数の累積和」
+		// prefix(k, x) = [0, x) のうち、現在の盤面の x' とゴールの x' - k が一致する数
+		class RowTable {
+		public:
+			void build(const OptimizedBoard& board, int32 y) {
+				m_width = board.width;
+				m_grid.resize(m_width);
+				m_goal.resize(m_width);
+				for (int32 x = 0; x < m_width; ++x) {
+					m_grid[x] = static_cast<uint8>(board.getGrid(x, y));
+					m_goal[x] = static_cast<uint8>(board.getGoal(x, y));
+				}
+				m_prefix.resize(static_cast<size_t>(2 * m_width - 1) * (m_width + 1));
+				for (int32 k = -(m_width - 1); k < m_width; ++k) {
+					int32* prefix = &m_prefix[static_cast<size_t>(k + m_width - 1) * (m_width + 1)];
+					// ゴールの x - k が盤面に入る範囲 [begin, end) の外は増えない
+					const int32 begin = Max(0, k), end = Min(m_width, m_width + k);
+					std::fill(prefix, prefix + begin + 1, 0);
+					for (int32 x = begin; x < end; ++x) {
+						prefix[x + 1] = prefix[x] + (m_grid[x] == m_goal[x - k]);
 					}
+					std::fill(prefix + end + 1, prefix + m_width + 1, prefix[end]);
 				}
 			}
 
-			if (candidates.empty()) {
-				return { -1, -1 };  // No valid point found
+			// 現在の盤面の [begin, end) とゴールの [begin - k, end - k) で一致する数
+			int32 count(int32 k, int32 begin, int32 end) const {
+				const int32* prefix = &m_prefix[static_cast<size_t>(k + m_width - 1) * (m_width + 1)];
+				return prefix[end] - prefix[begin];
 			}
 
-			// Step 3 & 5: Calculate popcount differences and find the minimum
-			int minPopcountDiff = std::numeric_limits<int>::max();
-			Point closestPoint = { -1, -1 };
-			for (const auto& [x, y] : candidates) {
-				int popcountDiff = popcount(y - b);
-				if (popcountDiff < minPopcountDiff) {
-					minPopcountDiff = popcountDiff;
-					closestPoint = { x,y };
+			// PlacementScorer::rowMatches と同じものを表で数える
+			int32 rowMatches(const std::vector<Run>& runs, bool left) const {
+				int32 removed = 0;
+				for (const auto& run : runs) removed += run.end - run.begin;
+
+				int32 total = 0, pos = 0;
+				int32 shift = left ? 0 : removed;
+				for (const auto& run : runs) {
+					if (pos < run.begin) total += count(left ? shift : -shift, pos, run.begin);
+					shift += left ? run.end - run.begin : -(run.end - run.begin);
+					pos = run.end;
 				}
-			}
-			return closestPoint;
-		}
+				if (pos < m_width) total += count(left ? shift : -shift, pos, m_width);
 
-		// 任意のマス(x, y) = (a, b)と同じ値のマス
-		std::vector<std::pair<int, int>> findPointsWithSameValue(int a, int b) const {
-			int target = getGoal(a, b);
-			std::vector<std::pair<int, int>> result;
-			for (int y = b; y < height; y++) {
-				for (int x = a; x < width; x++) {
-					if (target == getGrid(x, y)) {
-						result.emplace_back(x, y);
-					}
+				int32 offset = left ? m_width - removed : 0;
+				for (const auto& run : runs) {
+					total += count(run.begin - offset, run.begin, run.end);
+					offset += run.end - run.begin;
 				}
+				return total;
 			}
-			Console << U"res:" << result;
-			return result;
-		}
 
-		// 任意のマス(x, y) = (a, b)と同じ値のマスをpopcountでソート
-		std::vector<std::pair<int, int>> sortedFindPointsWithSameValue(int a, int b) const {
-			const int targetValue = getGoal(a, b);
-			// <座標, ポップカウント距離>
-			// std::vector<std::tuple<Point, int>> candidates;
-			std::vector<std::pair<int, int>> result;
-			for (int y = b; y < height; y++) {
-				for (int x = a; x < width; x++) {
-					if (getGrid(x, y) != targetValue) continue;
-					// 横向き移動は
-					int distance = popcount(abs(x - a)) + y != b;
-					// candidates.emplace_back(x, y, distance);
-					result.emplace_back(x, y);
-				}
+		private:
+			int32 m_width = 0;
+			std::vector<uint8> m_grid, m_goal;
+			std::vector<int32> m_prefix;
+		};
+
+		// y 行目から runs（盤面の列、左から順）を抜いて寄せたあとの、その行の一致数
+		// 左なら残りが左に詰まって抜いたマスが右端に並び、右なら逆になる
+		static int32 rowMatches(const OptimizedBoard& board, int32 y, const std::vector<Run>& runs, bool left) {
+			const int32 width = board.width, row = y * width;
+			int32 removed = 0;
+			for (const auto& run : runs) removed += run.end - run.begin;
+
+			int32 total = 0, pos = 0;
+			// 残るマスは、左なら前で抜かれた数、右なら後ろで抜かれる数だけずれる
+			int32 shift = left ? 0 : removed;
+			for (const auto& run : runs) {
+				if (pos < run.begin) total += board.equalCount(row + pos + (left ? -shift : shift), row + pos, run.begin - pos);
+				shift += left ? run.end - run.begin : -(run.end - run.begin);
+				pos = run.end;
 			}
-			return result;
-		}
+			if (pos < width) total += board.equalCount(row + pos + (left ? -shift : shift), row + pos, width - pos);
 
-		// 任意のマス(x, y) = (a, b)と同じ値かつY軸のポップカウントが1の点
-		std::vector<std::pair<int, int>> findPointsWithSameValueAndYPopcountDiff1(int a, int b) const {
-			int targetValue = getGoal(a, b);
-			std::vector<std::pair<int, int>> result;
-			std::random_device rd;
-			std::mt19937 gen(rd());
-			std::uniform_real_distribution<> dis(0.0, 0.3);
-			const double breakProb = 0.7;
-
-			for (const int dy : {1, 2, 4, 8, 16, 32, 64}) {
-				//for (const int dy : {64, 32, 16, 8, 4, 2, 1}) {
-				int ny = b + dy;
-				if (ny >= height) continue;
-				int cnt = 0;
-				for (int x : step(width)) {
-					if (getGrid(x, ny) == getGoal(a, b)) {
-						if (a == width - 1 || getGrid((x + 1) % width, ny) == getGoal(a + 1, b)) {
-							cnt++;
-							result.emplace_back(x, ny);
-						}
-					}
-				}
+			// 抜いたマスは順番どおりに端に並ぶ
+			int32 offset = left ? width - removed : 0;
+			for (const auto& run : runs) {
+				total += board.equalCount(row + offset, row + run.begin, run.end - run.begin);
+				offset += run.end - run.begin;
 			}
+			return total;
+		}
+	};
 
-			/*int siz = result.size();
-			if (width > 128) result.resize(siz / 3);*/
-			return result;
+	// 終盤の厳密解（最終行の末尾の数マスだけ）
+	// 未完成のマスが最終行の末尾 MaxCells マス以内に収まったときだけ、その区間を 2bit ずつ詰めた整数を
+	// 状態として幅優先探索（訪問済みの表つき）し、最短の手順を返す
+	// 最終行の残りがそれより長いときや、2行以上残っているときは何もしない
+	// （状態数がマス数の指数で増えるので、行全体や複数行は幅優先探索では扱えない。そこは呼び出し側の探索で進める）
+	// 揃った部分を崩さないように、区間の中に置いた左向きの手（タイプⅠ・タイプⅢ）だけを使う
+	// （最終行では上向きは何も変えず、右向きは行の先頭を崩す）
+	class EndgameSolver {
+	public:
+		static constexpr int MaxCells = 8;
+
+		// 終盤の条件を満たしているか
+		static bool applicable(const OptimizedBoard& board, int32 progress) {
+			return progress >= (board.height - 1) * board.width
+				&& board.width * board.height - progress <= MaxCells;
 		}
 
-		// 任意のマス(x, y) = (a, b)と同じ値かつY軸のポップカウントが1の点を期待値の高い順にソート
-		// 走査したい行を指定できる
-		// popcount(specificY - b) == 1である必要がある
-		std::vector<std::pair<int, int>> sortedFindPointsWithSameValueAndYPopcountDiff1(int a, int b, int specificY = -1) const {
-			int targetValue = getGoal(a, b);
-			std::vector<std::tuple<int, int, float>> result; // (x, y, count)
+		// board をゴールまで進め、使った手を moves の末尾に追加する
+		// 条件を満たさないときは何もせず false を返す
+		bool solve(OptimizedBoard& board, const Array<Pattern>& patterns, Array<Move>& moves) {
+			const int32 progress = board.getCorrectCount();
+			if (!applicable(board, progress) || board.isGoal()) return false;
 
-			auto calculateCount = [&](int sx, int sy, int nx, int ny) {
-				int dy = ny - sy;
-				if (dy == 0) {
-					for (int i = nx; i < width; i++) {
-						if (getGoal(i, sy) != getGrid(i, ny)) return i;
-					}
-					return nx - sx;
-				}
-				for (int i = 0; i < dy; i++) {
-					if (getGoal(sx + i, sy) != getGrid((nx + i) % width, ny)) return i;
-				}
-				int progress = sx + dy + sy * width;
-				sx = progress % width; sy = progress / width;
-				return dy + getCorrectCountFrom(sx, sy);
-			};
+			const int y = board.height - 1;
+			const int sx = progress - y * board.width;
+			const int length = board.width - sx;
 
-			if (specificY == -1) {
-				// dy = 0のとき
-				/*for (int dx : {1, 2, 4, 8, 16, 32, 64, 128}) {
-					if (a + dx >= width) break;
-					if (getGrid(a + dx, b) == targetValue) {
-						int count = calculateCount(a, b, a + dx, b);
-						int stepSize = 1;
-						result.emplace_back(a + dx, b, count);
-					}
-				}*/
-				for (const int dy : {1, 2, 4, 8, 16, 32, 64}) {
-					// if (dy == 1 && b < height - 2) continue;
-					int ny = b + dy;
-					if (ny >= height) break;
-					for (int x : step(width)) {
-						if (getGrid(x, ny) == targetValue) {
-							int count = calculateCount(a, b, x, ny);
-							int stepSize = x == a ? 1 : 2;
-							result.emplace_back(x, ny, count / stepSize);
+			uint32 start = 0, goal = 0;
+			for (int i = 0; i < length; ++i) {
+				start |= static_cast<uint32>(board.getGrid(sx + i, y)) << (2 * i);
+				goal |= static_cast<uint32>(board.getGoal(sx + i, y)) << (2 * i);
+			}
 
-						}
+			buildOperations(length);
+			m_parent.clear();
+			m_queue.clear();
+			m_parent.emplace(start, std::pair<uint32, int32>{ start, -1 });
+			m_queue.push_back(start);
+
+			for (size_t head = 0; head < m_queue.size(); ++head) {
+				const uint32 state = m_queue[head];
+				if (state == goal) break;
+				for (int k = 0; k < static_cast<int>(m_operations.size()); ++k) {
+					const uint32 next = m_operations[k].apply(state, length);
+					if (m_parent.emplace(next, std::pair<uint32, int32>{ state, k }).second) {
+						m_queue.push_back(next);
 					}
 				}
 			}
-			else if (specificY == b) {
-				// popcount(dx) = 1である必要がある
-				for (int dx : {1, 2, 4, 8, 16, 32, 64, 128}) {
-					if (a + dx >= width) break;
-					if (getGrid(a + dx, b) == targetValue) {
-						int count = calculateCount(a, b, a + dx, b);
-						int stepSize = 1;
-						result.emplace_back(a + dx, b, count);
-					}
-				}
+
+			// 値の個数が合っていれば必ず届くが、念のため
+			if (!m_parent.contains(goal)) return false;
+
+			m_path.clear();
+			for (uint32 state = goal; state != start; state = m_parent[state].first) {
+				m_path.push_back(m_parent[state].second);
 			}
-			else {
-				int ny = specificY;
-				///*for (int x : step(width)) */{
-				for (int dx : {1, 2, 4, 8, 16, 32, 64, 128}) {
-					int x = a + dx;
-					if (x >= width) break;
-					if (getGrid(x, ny) == targetValue) {
-						int count = calculateCount(a, b, x, ny);
-						int stepSize = x == a ? 1 : 2;
-						result.emplace_back(x, ny, count / stepSize);
-					}
-				}
+			for (auto it = m_path.rbegin(); it != m_path.rend(); ++it) {
+				const Operation& operation = m_operations[*it];
+				const Move move{ operation.patternIndex(), Point(sx + operation.offset, y), 2 };
+				applyMove(board, patterns, move);
+				moves.push_back(move);
 			}
+			return true;
+		}
 
-			// Sort result based on count in descending order
-			std::sort(result.begin(), result.end(),
-					  [](const auto& a, const auto& b) { return std::get<2>(a) > std::get<2>(b); });
-
-			// Convert sorted result to vector of pairs (x, y)
-			std::vector<std::pair<int, int>> sortedResult;
-			sortedResult.reserve(result.size());
-			float maxCount = -1;
-			for (const auto& [x, y, count] : result) {
-				maxCount = Max(maxCount, count);
-				if (count < maxCount) break;
-				sortedResult.emplace_back(x, y);
+	private:
+		// 区間の offset から幅 1 << bit の型を左向きに使う手
+		struct Operation {
+			int32 offset;
+			int32 bit;
+			bool evenColumns;  // タイプⅢ
+
+			int32 patternIndex() const { return powerOfTwoPatternIndex(bit) + (evenColumns ? 2 : 0); }
+
+			uint32 apply(uint32 state, int length) const {
+				const int end = Min(offset + (1 << bit), length);
+				uint32 kept = 0, removed = 0;
+				int keptCount = 0, removedCount = 0;
+				for (int i = 0; i < length; ++i) {
+					const uint32 cell = (state >> (2 * i)) & 3;
+					const bool hit = offset <= i && i < end && (!evenColumns || (i - offset) % 2 == 0);
+					if (hit) removed |= cell << (2 * removedCount++);
+					else kept |= cell << (2 * keptCount++);
+				}
+				return kept | (removed << (2 * keptCount));
 			}
+		};
 
-			// dy = 0のとき
-			for (int dx : {1, 2, 4, 8, 16, 32, 64, 128}) {
-				if (a + dx >= width) break;
-				if (getGrid(a + dx, b) == targetValue) {
-					int count = calculateCount(a, b, a + dx, b);
-					int stepSize = 1;
-					sortedResult.emplace_back(a + dx, b);
+		Array<Operation> m_operations;
+		std::unordered_map<uint32, std::pair<uint32, int32>> m_parent;  // 状態 -> (1つ前の状態, 手)
+		std::vector<uint32> m_queue;
+		std::vector<int32> m_path;
+
+		// 長さ length の区間で意味のある手を列挙
+		// 区間の端からはみ出す型は、はみ出し方が同じなら結果も同じなので最小のものだけ残す
+		void buildOperations(int length) {
+			m_operations.clear();
+			for (int offset = 0; offset < length; ++offset) {
+				for (int bit = 0; bit <= MaxPatternBit; ++bit) {
+					// 末尾まで覆うタイプⅠは抜いたものをそのまま末尾に戻すだけ
+					if (offset + (1 << bit) < length) m_operations.push_back({ offset, bit, false });
+					if (bit >= 1) m_operations.push_back({ offset, bit, true });
+					if (offset + (1 << bit) >= length) break;
 				}
 			}
+		}
+	};
+
+	// 改善系の探索の既定の制限時間（秒）
+	constexpr double DefaultTimeLimit = 200.0;
 
-			return sortedResult;
+	// 締め切りと中止フラグによる協調的な打ち切り
+	// 探索のループの区切りごとに expired() を見て、立っていれば手持ちの最良で切り上げる
+	class Deadline {
+	public:
+		// seconds <= 0 なら締め切りなし
+		Deadline(double seconds, const std::atomic<bool>* cancel)
+			: m_end(seconds > 0
+				? std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds))
+				: std::chrono::steady_clock::time_point::max())
+			, m_cancel(cancel) {}
+
+		explicit Deadline(const Options& options)
+			: Deadline(options.timeLimit, options.cancel) {}
+
+		bool expired() const {
+			if (m_cancel && m_cancel->load(std::memory_order_relaxed)) return true;
+			return std::chrono::steady_clock::now() >= m_end;
 		}
 
-		// 任意のマス(x, y) = (a, b)と同じ値のマスで、同じ行にあるものを探す
-		// (a, b) より右にあるもの
-		std::vector<std::pair<int, int>> findPointsWithSameValueInSameRow(int a, int b) {
-			std::vector<std::pair<int, int>> result;
-			int targetValue = getGoal(a, b);
-			for (int x = a + 1; x < width; x++) {
-				if (getGrid(x, b) != targetValue) continue;
-				result.emplace_back(x, b);
+	private:
+		std::chrono::steady_clock::time_point m_end;
+		const std::atomic<bool>* m_cancel;
+	};
+
+	// 探索用の乱数（xoshiro256**）
+	// スレッドごとに1つ持つ。同じ実行の種と系列番号からは常に同じ乱数列になる
+	// 系列番号の数だけ jump()（2^128 個先へ飛ぶ）するので、系列どうしは重ならない
+	class SolverRandom {
+	public:
+		using result_type = uint64;
+
+		SolverRandom(uint64 seed, uint32 stream = 0) {
+			// 種を splitmix64 で広げて内部状態にする（全 0 を避ける）
+			for (auto& word : m_state) {
+				seed += 0x9E3779B97F4A7C15ull;
+				uint64 z = seed;
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				word = z ^ (z >> 31);
 			}
+			for (uint32 i = 0; i < stream; ++i) jump();
 		}
 
-		// 異なる二つの行でどれだけ連続して揃っているか
-		// (sx, sy) ゴール盤面の始点
-		// (nx, ny) 現在の盤面の始点
-		int calculateSuccessiveArea(int sx, int sy, int nx, int ny) const {
-			int res = 0;
-			for (int cnt = 0; cnt < width; cnt++) {
-				if (getGoal(sx + cnt, sy) != getGrid(nx + cnt, ny)) break;
-				if (sx + cnt >= width || nx + cnt >= width) break;
-				res++;
-			}
-			return res;
-		}
-
-		// 異なる二つの行でどれだけ揃っているか
-		// (sx, sy) ゴール盤面の始点
-		// (nx, ny) 現在の盤面の始点
-		// nx == sx
-		int compareRows(int sx, int sy, int nx, int ny) const {
-			int cnt = 0;
-			for (int x = sx; x < width; x++) {
-				if (getGrid(x, ny) != getGoal(x, sy))continue;
-				cnt++;
-			}
-			return cnt;
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return UINT64_MAX; }
+
+		result_type operator()() {
+			const uint64 result = std::rotl(m_state[1] * 5, 7) * 9;
+			const uint64 t = m_state[1] << 17;
+			m_state[2] ^= m_state[0];
+			m_state[3] ^= m_state[1];
+			m_state[1] ^= m_state[2];
+			m_state[0] ^= m_state[3];
+			m_state[2] ^= t;
+			m_state[3] = std::rotl(m_state[3], 45);
+			return result;
 		}
 
-		// 特定の行を抜き出す
-		OptimizedBoard extractRow(int goalRow, int currentRow) const {
-			if (currentRow < 0 || currentRow >= height || goalRow < 0 || goalRow >= height) {
-				throw std::out_of_range("Invalid row index");
-			}
+		// [0, n) の整数（剰余を使わず、上位 32bit との掛け算で写す）
+		uint32 below(uint32 n) {
+			return static_cast<uint32>(((*this)() >> 32) * n >> 32);
+		}
 
-			OptimizedBoard newBoard(width, 1);
-			for (int x = 0; x < width; ++x) {
-				newBoard.set(x, 0, getGrid(x, currentRow));
-				newBoard._set(x, 0, getGoal(x, goalRow));
+	private:
+		void jump() {
+			constexpr uint64 JumpTable[] = { 0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull };
+			std::array<uint64, 4> next{};
+			for (const uint64 word : JumpTable) {
+				for (int b = 0; b < 64; ++b) {
+					if (word & (1ull << b)) {
+						for (int i = 0; i < 4; ++i) next[i] ^= m_state[i];
+					}
+					(*this)();
+				}
 			}
-			return newBoard;
+			m_state = next;
 		}
 
-		// 正解かどうか
-		bool isGoal()const {
-			// Console << getCorrectCountAll();
-			for (int i = 0; i < grid.size(); i++) {
-				if (grid[i] != goal[i])return false;
+		std::array<uint64, 4> m_state{};
+	};
+
+	// 並列に使うスレッド数（Options::threads が 0 以下なら論理コア数）
+	int32 solverThreads(const Options& options) {
+		return options.threads > 0 ? options.threads : Max(1, static_cast<int32>(std::thread::hardware_concurrency()));
+	}
+
+	// 実行の種（Options::seed が 0 ならその都度作る）
+	uint64 runSeed(const Options& options) {
+		if (options.seed != 0) return options.seed;
+		std::random_device device;
+		return (static_cast<uint64>(device()) << 32) | device();
+	}
+
+	// 貪欲が1行を仕上げた手順の記録
+	// 先頭 progress マスが揃っていれば、残りのマスが同じ盤面から貪欲は必ず同じ手順でその行を終える
+	// 改善貪欲の試行は似た盤面を何度も通るので、行の頭で (progress, 残りのマス) のハッシュを引き、当たれば手順をそのまま使う
+	// 衝突しても合法手を並べるだけで、その後も貪欲がゴールまで進めるので解は壊れない
+	class RowPlanCache {
+	public:
+		// 記録する手の総数の上限（超えたら全部捨てて作り直す）
+		static constexpr size_t MaxMoves = 1 << 18;
+
+		static uint64_t key(const OptimizedBoard& board, int32 progress) {
+			return board.suffixHash(progress);
+		}
+
+		// 見つかれば手順を moves の末尾に足して盤面に適用する
+		bool splice(uint64_t key, OptimizedBoard& board, const Array<Pattern>& patterns, Array<Move>& moves) {
+			++m_lookups;
+			PROFILE_COUNT(CacheLookups, 1);
+			const auto it = m_plans.find(key);
+			if (it == m_plans.end()) return false;
+			++m_hits;
+			PROFILE_COUNT(CacheHits, 1);
+			const auto [offset, length] = it->second;
+			for (uint32 i = offset; i < offset + length; ++i) {
+				applyMove(board, patterns, m_moves[i]);
+				moves.push_back(m_moves[i]);
 			}
 			return true;
 		}
 
+		// moves[begin, end) をその行の手順として記録する
+		void store(uint64_t key, const Array<Move>& moves, size_t begin) {
+			const size_t length = moves.size() - begin;
+			if (length == 0 || length > MaxMoves) return;
+			if (m_moves.size() + length > MaxMoves) {
+				m_moves.clear();
+				m_plans.clear();
+			}
+			if (!m_plans.try_emplace(key, static_cast<uint32>(m_moves.size()), static_cast<uint32>(length)).second) return;
+			m_moves.insert(m_moves.end(), moves.begin() + begin, moves.end());
+		}
+
+		int64_t lookups() const { return m_lookups; }
+		int64_t hits() const { return m_hits; }
+
+	private:
+		std::unordered_map<uint64_t, std::pair<uint32, uint32>> m_plans;
+		std::vector<Move> m_moves;
+		int64_t m_lookups = 0;
+		int64_t m_hits = 0;
 	};
 
+	// 貪欲で使い回す作業領域
+	// 1回の探索の間に何度も確保し直さないように、呼び出し側で持っておく
+	struct GreedyWorkspace {
+		SearchBuffer search;
+		// 貪欲を呼ぶたびに作り直さず、盤面の dirty な行から更新する
+		SegmentIndex segments;
+		EndgameSolver endgame;
+		std::vector<std::pair<int, int>> targets;
+		std::vector<ScoredPoint> rankedTargets;
+		// 候補の試し打ち用の盤面（評価するスレッドごとに1枚）と、候補ごとの手順・評価
+		std::vector<OptimizedBoard> trials;
+		std::vector<std::pair<MoveList, double>> evaluations;
+		MoveList best;
+		// 候補の評価に使うスレッド数（改善貪欲のワーカーの中では 1）
+		int32 threads = 1;
+		// 設定されていれば、締め切りを過ぎたあとは候補を比べずに最後まで揃える
+		const Deadline* deadline = nullptr;
+		// 締め切りを過ぎたら揃えずに false で打ち切る（改善貪欲の試行のように、途中の解を捨ててよいとき）
+		bool abandonOnDeadline = false;
+		// 設定されていれば、行ごとの手順を記録して使い回す
+		RowPlanCache* rowPlans = nullptr;
+		// 設定されていれば、一般抜き型も使う
+		const GeneralPatternIndex* general = nullptr;
+	};
 
-	Array<Solution> optimizedNextState(const OptimizedBoard& initialBoard, const Array<Pattern>& patterns) {
-		Array<Solution> solutions;
+	// 次の候補手順を列挙
+	// 結果は solutions に入る（呼び出し側で使い回す）
+	void optimizedNextState(const OptimizedBoard& initialBoard, SearchBuffer& buffer, Array<MoveList>& solutions, const GeneralPatternIndex* general = nullptr) {
+		PROFILE_ZONE("optimizedNextState");
+		solutions.clear();
 		const int32 width = initialBoard.width;
 		const int32 height = initialBoard.height;
 		const int32 correctCount = initialBoard.getCorrectCount();
 		const int32 y = correctCount / width;
 		const int32 x = correctCount % width;
-
-		// メモリ確保を一度だけ行う
-		solutions.reserve(32);  // 通常のケースで十分な数
+		const MoveTable moveTable(width, height, general);
 
 		// 最も可能性の高い候補を先に探索
-		const auto& candidates = initialBoard.sortedFindPointsWithSameValueAndYPopcountDiff1(x, y);
+		const auto& candidates = initialBoard.sortedFindPointsWithSameValueAndYPopcountDiff1(x, y, buffer, -1, general);
 
 		for (const auto& [nx, ny] : candidates) {
 			const int32 dy = ny - y;
 			const int32 dx = nx - x;
-			Solution solution;
-
-			// 水平移動の場合
-			if (dy == 0) {
-				const int bit = log2(std::abs(dx));
-				const auto& pattern = bit == 0 ? patterns[0] : patterns[3 * (bit - 1) + 1];
-				solution.steps.emplace_back(pattern, Point(x, y), 2);
-				solutions.emplace_back(std::move(solution));
-				continue;
-			}
-
-			// 垂直または斜め移動の場合
-			if (dx != 0) {
-				if (dx > 0) {
-					solution.steps.emplace_back(patterns[22], Point(dx - 256, y + 1), 2);
-				}
-				else {
-					solution.steps.emplace_back(patterns[22], Point(nx + (width - x), y + 1), 3);
-				}
-			}
+			MoveList solution;
 
-			// 垂直移動のパターンを追加
-			if (dy > 0) {
-				const int bit = log2(dy);
-				const auto& pattern = bit == 0 ? patterns[0] : patterns[3 * (bit - 1) + 1];
-				solution.steps.emplace_back(pattern, Point(x, y), 0);
-			}
+			// 水平移動、または回り込み + 垂直移動
+			moveTable.appendRelocation(x, y, dx, dy, y + 1, solution);
 
-			if (!solution.steps.empty()) {
-				solutions.emplace_back(std::move(solution));
+			if (!solution.empty()) {
+				solutions.push_back(solution);
 			}
 		}
 
@@ -703,509 +869,1101 @@ namespace Algorithm {
 			const int target = initialBoard.getGoal(x, y);
 
 			// 同じ行での探索（最適化：範囲を限定）
-			for (int nx = x + 1; nx < width; nx++) {
-				if (initialBoard.getGrid(nx, y) == target) {
-					Solution solution;
-					const int dx = nx - x;
-					const int bit = log2(dx);
-					const auto& pattern = bit == 0 ? patterns[0] : patterns[3 * (bit - 1) + 1];
-					solution.steps.emplace_back(pattern, Point(x, y), 2);
-					solutions.emplace_back(std::move(solution));
-				}
-			}
+			initialBoard.forEachCellWithValue(y, target, x + 1, [&](int nx) {
+				MoveList solution;
+				moveTable.appendShifts(nx - x, Point(x, y), 2, solution);
+				solutions.push_back(solution);
+			});
 
 			// 他の行での探索（最適化：早期リターン条件を追加）
 			if (solutions.empty()) {
 				for (int ny = y + 1; ny < height; ny++) {
 					bool foundInRow = false;
-					for (int nx = 0; nx < width; nx++) {
-						if (initialBoard.getGrid(nx, ny) != target) continue;
+					initialBoard.forEachCellWithValue(ny, target, 0, [&](int nx) {
+						if (solutions.size() >= 16) return;  // 十分な候補が見つかった場合は探索を終了
 
-						Solution solution;
-						const int dx = nx - x;
-						const int dy = ny - y;
-
-						// 移動パターンの最適化
-						if (dx != 0) {
-							if (dx > 0) {
-								solution.steps.emplace_back(patterns[22], Point(dx - 256, y + 1), 2);
-							}
-							else {
-								solution.steps.emplace_back(patterns[22], Point(nx + (width - x), y + 1), 3);
-							}
-						}
-
-						// 垂直移動の最適化（ビット演算を使用）
-						for (int bit = 0; bit < 8; bit++) {
-							if (dy & (1 << bit)) {
-								const auto& pattern = bit == 0 ? patterns[0] : patterns[3 * (bit - 1) + 1];
-								solution.steps.emplace_back(pattern, Point(x, y), 0);
-							}
-						}
-
-						solutions.emplace_back(std::move(solution));
+						MoveList solution;
+						moveTable.appendRelocation(x, y, nx - x, ny - y, y + 1, solution);
+						solutions.push_back(solution);
 						foundInRow = true;
-						if (solutions.size() >= 16) break;  // 十分な候補が見つかった場合は探索を終了
-					}
+					});
 					if (foundInRow) break;  // 1行で見つかった場合は探索を終了
 				}
 			}
 		}
-
-		return solutions;
+		PROFILE_COUNT(CandidatesGenerated, solutions.size());
 	}
 
 
-	Solution beamSearch(const Board& initialBoard, const Array<Pattern>& patterns) {
+	bool optimizedGreedy(OptimizedBoard& board, const Array<Pattern>& patterns, Array<Move>& moves, GreedyWorkspace& workspace, size_t stepLimit = std::numeric_limits<size_t>::max());
+
+	Solution beamSearch(const Board& initialBoard, const Array<Pattern>& patterns, const Options& options) {
+		PROFILE_ZONE("beamSearch");
 		const int32 height = initialBoard.height;
 		const int32 width = initialBoard.width;
 		// 20/30 : 1797/200sec
 		// 30/30 : 1777/430sec
 		// 25/25 : 1806/200sec
-		const int beamWidth = 20;
+		const int beamWidth = options.beamWidth > 0 ? options.beamWidth : 20;
 		const int beamDepth = 30;
 
 		struct State {
 			OptimizedBoard board;
-			Solution solution;
+			Array<Move> moves;
 			double score;
 			int32 progress;
 
-			// コンストラクタを単純化
-			State(const OptimizedBoard& b, const Solution& s, double sc, int32 prog)
-				: board(b)
-				, solution(s)
+			State(OptimizedBoard&& b, Array<Move>&& m, double sc, int32 prog)
+				: board(std::move(b))
+				, moves(std::move(m))
 				, score(sc)
 				, progress(prog) {}
-		};
 
-		// スコア計算関数
-		auto calculateScore = [](int correctCount, int stepCount, int totalCells) {
-			return static_cast<double>(correctCount) / (stepCount + 1);
+			size_t memoryUsage() const {
+				return sizeof(State) + board.memoryUsage() + moves.capacity() * sizeof(Move);
+			}
 		};
 
-		// 状態比較関数
-		auto compareStates = [](const State& a, const State& b) {
-			return a.score < b.score;
+		// 次の層は良い方から width 個だけ残す（悪いものが先頭のヒープ）
+		auto worseFirst = [](const State& a, const State& b) {
+			return a.score > b.score;
 		};
 
 		OptimizedBoard board(width, height, initialBoard.grid, initialBoard.goal);
-		Solution finalSolution;
+		Array<Move> finalMoves;
 		const auto startTime = std::chrono::high_resolution_clock::now();
+		const Deadline deadline(options);
+		const GeneralPatternIndex general(patterns);
+
+		// 予算があれば、次の層は「予算 - 使用中」に収まる数だけ残す（最低1つ）
+		const size_t budget = options.beamMemoryBudget;
+		// 予算のために捨てた状態の数
+		size_t droppedForBudget = 0;
+		// 今の層と次の層の状態が使っているメモリ（各状態の memoryUsage() の和）とその最大
+		size_t liveBytes = 0, peakBytes = 0;
+
+		// 候補列挙用のバッファ
+		SearchBuffer buffer;
+		Array<MoveList> legalActions;
+
+		if (options.rowPlacement) {
+			RowPlacement::apply(board, patterns, finalMoves);
+		}
+
+		EndgameSolver endgame;
+		// 今の層（良い順）と次の層
+		std::vector<State> beam, nextBeam;
 
 		while (!board.isGoal()) {
-			std::priority_queue<State, std::vector<State>, decltype(compareStates)> beam(compareStates);
-			beam.emplace(board, Solution(), 0, board.getCorrectCount());
+			// 締め切りを過ぎたら、残りは貪欲で仕上げる
+			if (deadline.expired()) break;
 
+			// 最終行の末尾 MaxCells マスだけが残ったら厳密解で仕上げる
+			if (endgame.solve(board, patterns, finalMoves)) break;
 
-			State bestState = beam.top();
-			bool goalFound = false;
+			beam.clear();
+			beam.emplace_back(OptimizedBoard(board), Array<Move>(), 0, board.getCorrectCount());
+			liveBytes = beam.front().memoryUsage();
 
-			for (int32 t = 0; t < beamDepth && !goalFound; ++t) {
-				std::priority_queue<State, std::vector<State>, decltype(compareStates)> nextBeam(compareStates);
-				Console << U"progres:{}/step:{}"_fmt(bestState.progress, bestState.solution.steps.size());
-				for (int32 w = 0; w < beamWidth && !beam.empty(); ++w) {
-					State currentState = beam.top();
-					beam.pop();
+			State bestState = beam.front();
+			bool goalFound = false;
 
+			for (int32 t = 0; t < beamDepth && !goalFound && !deadline.expired(); ++t) {
+				PROFILE_ZONE("beamSearch/layer");
+				nextBeam.clear();
+				Console << U"progres:{}/step:{}"_fmt(bestState.progress, bestState.moves.size());
+				for (const State& currentState : beam) {
 					if (currentState.board.isGoal()) {
 						bestState = currentState;
 						goalFound = true;
 						break;
 					}
 
-					const auto& legalActions = optimizedNextState(currentState.board, patterns);
+					optimizedNextState(currentState.board, buffer, legalActions, &general);
+					PROFILE_COUNT(StatesExpanded, 1);
 
 					for (const auto& solutions : legalActions) {
-						if (solutions.steps.empty()) continue;
+						if (solutions.empty()) continue;
 
 						OptimizedBoard nextBoard = currentState.board;
-						Solution nextSolution = currentState.solution;
-
-						for (const auto& action : solutions.steps) {
-							const auto& [pattern, point, direction] = action;
-							nextBoard.apply_pattern(pattern, point, direction);
-							nextSolution.steps.emplace_back(action);
+						for (const auto& action : solutions) {
+							applyMove(nextBoard, patterns, action);
 						}
 
+						const size_t stepCount = currentState.moves.size() + solutions.size();
+
 						int32 prog = nextBoard.getCorrectCount();
 						double delta = prog - currentState.progress;
-						double newScore = delta / solutions.steps.size() *
-							prog / nextSolution.steps.size() *
+						double newScore = delta / solutions.size() *
+							prog / stepCount *
 							board.getCorrectCountAll();
 
-						nextBeam.emplace(nextBoard, nextSolution, newScore, prog);
+						// 次の層が埋まっている（幅か予算に達した）とき、その最悪より良くなければ残さない
+						const bool full = nextBeam.size() >= static_cast<size_t>(beamWidth) || (budget > 0 && liveBytes >= budget);
+						if (!nextBeam.empty() && full && newScore <= nextBeam.front().score) continue;
+
+						Array<Move> nextMoves;
+						nextMoves.reserve(stepCount);
+						nextMoves.assign(currentState.moves.begin(), currentState.moves.end());
+						nextMoves.insert(nextMoves.end(), solutions.begin(), solutions.end());
+
+						nextBeam.emplace_back(std::move(nextBoard), std::move(nextMoves), newScore, prog);
+						liveBytes += nextBeam.back().memoryUsage();
+						std::push_heap(nextBeam.begin(), nextBeam.end(), worseFirst);
+						peakBytes = Max(peakBytes, liveBytes);
+						// 幅を超えたか予算を超えたら、悪いものから捨てる
+						while (nextBeam.size() > 1 && (nextBeam.size() > static_cast<size_t>(beamWidth) || (budget > 0 && liveBytes > budget))) {
+							if (nextBeam.size() <= static_cast<size_t>(beamWidth)) ++droppedForBudget;
+							std::pop_heap(nextBeam.begin(), nextBeam.end(), worseFirst);
+							liveBytes -= nextBeam.back().memoryUsage();
+							nextBeam.pop_back();
+						}
 					}
 				}
 
-				if (nextBeam.empty()) break;
-				beam = std::move(nextBeam);
-				bestState = beam.top();
+				if (goalFound || nextBeam.empty()) break;
+				for (const State& state : beam) liveBytes -= state.memoryUsage();
+				std::sort_heap(nextBeam.begin(), nextBeam.end(), worseFirst);
+				std::swap(beam, nextBeam);
+				bestState = beam.front();
 			}
 
-			if (bestState.solution.steps.empty()) break;
+			if (bestState.moves.empty()) break;
 
 			// 最良の解を適用
-			for (const auto& action : bestState.solution.steps) {
-				const auto& [pattern, point, direction] = action;
-				board.apply_pattern(pattern, point, direction);
-				finalSolution.steps.emplace_back(action);
+			for (const auto& action : bestState.moves) {
+				applyMove(board, patterns, action);
+				finalMoves.push_back(action);
 			}
 
 			Console << U"progress:" << board.getCorrectCount();
 			if (board.isGoal()) break;
 		}
 
+		Console << U"beam width: " << beamWidth << U", dropped for memory: " << droppedForBudget << U", peak state memory: " << (peakBytes / 1024) << U" KiB";
+		if (options.stats) {
+			size_t recorded = options.stats->peakStateBytes.load();
+			while (recorded < peakBytes && !options.stats->peakStateBytes.compare_exchange_weak(recorded, peakBytes)) {}
+		}
+
 		const auto currentTime = std::chrono::high_resolution_clock::now();
 		const double elapsedTime = std::chrono::duration<double>(currentTime - startTime).count();
 		Console << elapsedTime << U"sec";
 
-		return finalSolution;
+		// 進める状態がなくなったとき、締め切りに間に合わなかったときは、そこから貪欲で仕上げる
+		if (!board.isGoal()) {
+			GreedyWorkspace workspace;
+			workspace.deadline = &deadline;
+			workspace.general = &general;
+			workspace.threads = solverThreads(options);
+			optimizedGreedy(board, patterns, finalMoves, workspace);
+			Console << U"beam stopped early, finished with greedy: " << finalMoves.size();
+		}
+
+		return toSolution(finalMoves, patterns);
 	}
 
-	Solution greedy(const Board& initialBoard, const Array<Pattern>& patterns) {
-		OptimizedBoard board(initialBoard.width, initialBoard.height, initialBoard.grid, initialBoard.goal);
+	// 貪欲で候補が見つからなかったときに、盤面を動かして試す候補の数
+	constexpr size_t FallbackCandidates = 8;
+
+	// 貪欲の本体
+	// board をゴールまで進め、使った手を moves の末尾に追加する
+	// moves が stepLimit 手未満で終われないと分かった時点で打ち切り、false を返す
+	bool optimizedGreedy(OptimizedBoard& board, const Array<Pattern>& patterns, Array<Move>& moves, GreedyWorkspace& workspace, size_t stepLimit) {
+		PROFILE_ZONE("optimizedGreedy");
 		// Z字に進行(横書き文章の順)
 		// 3HWで解く
 		// 1番右の列を移動につかうことで3HWで解ける?
-		auto startTime = std::chrono::high_resolution_clock::now();
-		Solution solution;
+		MoveList& bestMoves = workspace.best;
+		const MoveTable moveTable(board.width, board.height, workspace.general);
+		workspace.segments.prepare(board);
+		const int32 threads = Max(1, workspace.threads);
+		if (static_cast<int32>(workspace.trials.size()) < threads) {
+			workspace.trials.resize(threads, OptimizedBoard(1, 1));
+		}
+		double bestProgressDelta = 0;
+
+		// 候補 [0, count) の手順を makeMoves(i, moves) で作って試し、手数あたりの進みが最大の手順を bestMoves にする
+		// 候補ごとの評価は独立なので並列に行い、比べるのは候補の順に1スレッドで行う（同点なら先の候補で、1スレッドと同じ結果）
+		auto evaluateCandidates = [&](int32 count, int32 progress, auto&& makeMoves) {
+			PROFILE_COUNT(CandidatesGenerated, count);
+			auto& evaluations = workspace.evaluations;
+			evaluations.resize(count);
+			const int32 teamSize = Min(threads, count);
+#pragma omp parallel for schedule(dynamic) num_threads(teamSize) if(teamSize > 1)
+			for (int32 i = 0; i < count; ++i) {
+				auto& [trialMoves, delta] = evaluations[i];
+				trialMoves.clear();
+				delta = 0;
+				makeMoves(i, trialMoves);
+				if (trialMoves.empty()) continue;
+
+				OptimizedBoard& trial = workspace.trials[omp_get_thread_num()];
+				trial = board;
+				for (const auto& move : trialMoves) {
+					applyMove(trial, patterns, move);
+				}
+				delta = double(trial.getCorrectCount() - progress) / trialMoves.size();
+			}
+			for (int32 i = 0; i < count; ++i) {
+				if (evaluations[i].second > bestProgressDelta) {
+					bestProgressDelta = evaluations[i].second;
+					bestMoves = evaluations[i].first;
+				}
+			}
+		};
+
+		// 記録中の行（-1 なら記録していない）と、その行の頭の盤面のキー・手の位置
+		int32 planRow = -1;
+		uint64_t planKey = 0;
+		size_t planBegin = 0;
+
 		while (!board.isGoal()) {
+			if (!board.canFinishWithin(moves.size(), stepLimit)) return false;
+			const bool expired = workspace.deadline && workspace.deadline->expired();
+			if (expired && workspace.abandonOnDeadline) return false;
 
 			int32 progress = board.getCorrectCount();
 			int32 sy = progress / board.width, sx = progress % board.width;
-			Console << U"sy:" << sy;
-			const auto& candidates = board.sortedFindPointsWithSameValueAndYPopcountDiff1(sx, sy);
-
-			Solution bestSolution;
-			double bestProgressDelta = 0;
-
-			for (const auto& [nx, ny] : candidates) {
-				OptimizedBoard currentBoard = board;
-				// Console << U"nx, ny : " << Point(nx, ny);
-				Solution currentSolution;
-				const int32 dy = ny - sy, dx = nx - sx;
-
-				if (dy == 0) {
-					const int bit = log2(dx);
-					const auto& pattern = bit == 0 ? patterns[0] : patterns[3 * (bit - 1) + 1];
-					currentBoard.apply_pattern(pattern, Point(sx, sy), 2);
-					currentSolution.steps.emplace_back(pattern, Point(sx, sy), 2);
+
+			// 締め切り後は、同じ行か一番近い下の行から一番安く運べるマスを1つ選んで持ってくる
+			if (expired) {
+				const int target = board.getGoal(sx, sy);
+				int bestX = -1, bestY = -1, bestCost = std::numeric_limits<int>::max();
+				for (int ny = sy; ny < board.height && bestY < 0; ++ny) {
+					board.forEachCellWithValue(ny, target, ny == sy ? sx + 1 : 0, [&](int nx) {
+						const int cost = MoveTable::relocationCost(nx - sx, ny - sy);
+						if (cost < bestCost) {
+							bestCost = cost;
+							bestX = nx;
+							bestY = ny;
+						}
+					});
 				}
-				else {
-					if (dx > 0) {
-						currentBoard.apply_pattern(patterns[22], Point(dx - 256, ny), 2);
-						currentSolution.steps.emplace_back(patterns[22], Point(dx - 256, ny), 2);
-					}
-					else if (dx < 0) {
-						currentBoard.apply_pattern(patterns[22], Point(dx + board.width, ny), 3);
-						currentSolution.steps.emplace_back(patterns[22], Point(dx + board.width, ny), 3);
-					}
+				if (bestY < 0) return false;
+				bestMoves.clear();
+				moveTable.appendRelocation(sx, sy, bestX - sx, bestY - sy, sy + 1, bestMoves);
+				for (const auto& move : bestMoves) {
+					applyMove(board, patterns, move);
+					moves.push_back(move);
+				}
+				continue;
+			}
 
+			// 最終行の末尾 MaxCells マスだけが残ったら厳密解で仕上げる
+			if (EndgameSolver::applicable(board, progress) && workspace.endgame.solve(board, patterns, moves)) {
+				break;
+			}
 
-					if (dy > 0) {
-						const int bit = log2(dy);
-						const auto& pattern = bit == 0 ? patterns[0] : patterns[3 * (bit - 1) + 1];
-						currentBoard.apply_pattern(pattern, Point(sx, sy), 0);
-						currentSolution.steps.emplace_back(pattern, Point(sx, sy), 0);
-					}
-				}
-				if (currentSolution.steps.size() == 0) {
-					// Console << U"step size 0 " << Point(nx, ny);
+			// 行が変わったら、前の行の手順を記録して、新しい行の手順を探す
+			if (workspace.rowPlans && sy != planRow) {
+				if (planRow >= 0) workspace.rowPlans->store(planKey, moves, planBegin);
+				planKey = RowPlanCache::key(board, progress);
+				if (workspace.rowPlans->splice(planKey, board, patterns, moves)) {
+					planRow = -1;
 					continue;
 				}
-				double currentProgressDelta = double(currentBoard.getCorrectCount() - progress) / currentSolution.steps.size();
-				if (currentProgressDelta > bestProgressDelta) {
-					bestProgressDelta = currentProgressDelta;
-					bestSolution = currentSolution;
-				}
+				planRow = sy;
+				planBegin = moves.size();
 			}
 
+			const auto& candidates = board.sortedFindPointsWithSameValueAndYPopcountDiff1(sx, sy, workspace.search, -1, workspace.general);
+			PROFILE_COUNT(StatesExpanded, 1);
+
+			bestMoves.clear();
+			bestProgressDelta = 0;
+			evaluateCandidates(static_cast<int32>(candidates.size()), progress, [&](int32 i, MoveList& candidateMoves) {
+				const auto [nx, ny] = candidates[i];
+				moveTable.appendRelocation(sx, sy, nx - sx, ny - sy, ny, candidateMoves);
+			});
+
 			// 見つからなかったとき
-			if (bestSolution.steps.empty()) {
-				std::vector<std::pair<int, int>> targets;
+			if (bestMoves.empty()) {
+				auto& targets = workspace.targets;
+				targets.clear();
 				int target = board.getGoal(sx, sy);
 				//　同じ行で探す
-				for (int nx = sx; nx < board.width; nx++) {
-					if (board.getGrid(nx, sy) == target) {
-						targets.emplace_back(nx, sy);
-					}
-				}
+				board.forEachCellWithValue(sy, target, sx, [&](int nx) {
+					targets.emplace_back(nx, sy);
+				});
 
 				// 別の行( popcountで差が1じゃない行)
 				for (int ny = sy + 1; ny < board.height; ny++) {
-					for (int nx : step(board.width)) {
-						if (board.getGrid(nx, ny) != target) continue;
+					board.forEachCellWithValue(ny, target, 0, [&](int nx) {
 						targets.emplace_back(nx, ny);
-					}
+					});
 				}
 
+				// 索引で各候補が運んでくる連続区間の長さを見積もり、手数あたりの見込みが高いものだけを試す
+				workspace.segments.sync(board);
+				auto& ranked = workspace.rankedTargets;
+				ranked.clear();
 				for (const auto& [gx, gy] : targets) {
-					int dx = gx - sx, dy = gy - sy;
-					Solution currentSolution;
-					OptimizedBoard currentBoard = board;
-					if (dy > 0) {
-						if (dx > 0) {
-							currentSolution.steps.emplace_back(patterns[22], Point(dx - 256, sy + 1), 2);
-							currentBoard.apply_pattern(patterns[22], Point(dx - 256, sy + 1), 2);
-						}
-						else if (dx < 0) {
-							currentSolution.steps.emplace_back(patterns[22], Point(gx + (board.width - sx), sy + 1), 3);
-							currentBoard.apply_pattern(patterns[22], Point(gx + (board.width - sx), sy + 1), 3);
-						}
-						for (int bit : step(8)) {
-							if ((dy >> bit) & 1) {
-								const auto& pattern = (bit == 0) ? patterns[0] : patterns[3 * (bit - 1) + 1];
-								currentSolution.steps.emplace_back(pattern, Point(sx, sy), 0);
-								currentBoard.apply_pattern(pattern, Point(sx, sy), 0);
-							}
-						}
-					}
-					else {
-						for (int bit : step(8)) {
-							if ((dx >> bit) & 1) {
-								const auto& pattern = (bit == 0) ? patterns[0] : patterns[3 * (bit - 1) + 1];
-								currentSolution.steps.emplace_back(pattern, Point(sx, sy), 2);
-								currentBoard.apply_pattern(pattern, Point(sx, sy), 2);
-							}
-						}
-					}
-
-					double currentProgressDelta = double(currentBoard.getCorrectCount() - progress) / currentSolution.steps.size();
-					// Console << U"best:{}, current:{}"_fmt(bestProgressDelta, currentProgressDelta);
-					if (currentProgressDelta > bestProgressDelta) {
-						bestProgressDelta = currentProgressDelta;
-						bestSolution = currentSolution;
-					}
+					const int dx = gx - sx, dy = gy - sy;
+					int32 run = workspace.segments.commonExtension(sx, sy, gx, gy);
+					// 縦に寄せるときは最小の型の幅までしか運べない
+					if (dy > 0) run = Min(run, dy & -dy);
+					ranked.push_back({ gx, gy, static_cast<float>(run) / MoveTable::relocationCost(dx, dy) });
 				}
+				const size_t trialCount = Min(ranked.size(), FallbackCandidates);
+				std::partial_sort(ranked.begin(), ranked.begin() + trialCount, ranked.end(), [](const ScoredPoint& a, const ScoredPoint& b) {
+					return a.score > b.score;
+				});
+
+				evaluateCandidates(static_cast<int32>(trialCount), progress, [&](int32 i, MoveList& candidateMoves) {
+					const int gx = ranked[i].x, gy = ranked[i].y;
+					moveTable.appendRelocation(sx, sy, gx - sx, gy - sy, sy + 1, candidateMoves);
+				});
 			}
-			for (const auto& action : bestSolution.steps) {
-				const auto& [pattern, point, direction] = action;
-				board.apply_pattern(pattern, point, direction);
-				solution.steps.emplace_back(action);
-				// Console << U"pattern:{}, Point:{}, direction:{}"_fmt(pattern.p, point, direction);
+			for (const auto& move : bestMoves) {
+				applyMove(board, patterns, move);
+				moves.push_back(move);
 			}
 
 		}
+		return true;
+	}
+
+	Solution greedy(const Board& initialBoard, const Array<Pattern>& patterns, const Options& options) {
+		PROFILE_ZONE("greedy");
+		OptimizedBoard board(initialBoard.width, initialBoard.height, initialBoard.grid, initialBoard.goal);
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		const GeneralPatternIndex general(patterns);
+		GreedyWorkspace workspace;
+		const Deadline deadline(options);
+		workspace.deadline = &deadline;
+		workspace.general = &general;
+		workspace.threads = solverThreads(options);
+		Array<Move> moves;
+		if (options.rowPlacement) {
+			RowPlacement::apply(board, patterns, moves);
+		}
+		optimizedGreedy(board, patterns, moves, workspace);
 
 		auto currentTime = std::chrono::high_resolution_clock::now();
 		double elapsedTime = std::chrono::duration<double>(currentTime - startTime).count();
 		Console << elapsedTime << U"sec";
 
-		return solution;
+		return toSolution(moves, patterns);
 	}
 
+	// 二段階法の1段目
+	// 縦の手だけで、上の行から順に「行に入っている値の個数」をゴールの行と同じにする（並びは問わない）
+	// 1手は「2^k 下の行の区間を、2^k の正方形（タイプⅠ）で真上に持ち上げる」で、必要なら先にその行以降を横に回して区間を合わせる
+	class RowBalancer {
+	public:
+		// board を進め、使った手を moves の末尾に追加する
+		// すべての行を揃えられなかったとき（締め切り・手が見つからない）は false
+		static bool apply(OptimizedBoard& board, const Array<Pattern>& patterns, Array<Move>& moves, const Deadline* deadline) {
+			const int32 width = board.width;
+			const int32 height = board.height;
+			const MoveTable moveTable(width, height);
+			MoveList step;
+
+			for (int32 y = 0; y + 1 < height; ++y) {
+				std::array<int32, 4> goalCount{};
+				for (int32 x = 0; x < width; ++x) ++goalCount[board.getGoal(x, y)];
+
+				while (true) {
+					if (deadline && deadline->expired()) return false;
+					std::array<int32, 4> count{};
+					for (int32 x = 0; x < width; ++x) ++count[board.getGrid(x, y)];
+					const int32 mismatch = excess(count, goalCount);
+					if (mismatch == 0) break;
+
+					step.clear();
+					if (const Candidate best = findBest(board, y, count, goalCount, mismatch); best.gain > 0) {
+						if (best.dx != 0) moveTable.appendWrap(best.dx, y + (1 << best.bit), step);
+						step.push_back({ powerOfTwoPatternIndex(best.bit), Point(best.x, y), 0 });
+					}
+					else {
+						// 2^k 下の行に足りない値がないときは、一番近い行から y + 1 行目の余っているマスの下に持ってくる
+						// （y 行目には触れないので、次の1手で必ず1つ減る）
+						int32 sx = 0;
+						for (; sx < width; ++sx) {
+							const int32 value = board.getGrid(sx, y);
+							if (count[value] > goalCount[value]) break;
+						}
+						if (sx == width) return false;
+						for (int32 ny = y + 2; ny < height && step.empty(); ++ny) {
+							for (int32 nx = 0; nx < width; ++nx) {
+								const int32 value = board.getGrid(nx, ny);
+								if (count[value] < goalCount[value]) {
+									moveTable.appendRelocation(sx, y + 1, nx - sx, ny - (y + 1), ny, step);
+									break;
+								}
+							}
+						}
+						if (step.empty()) return false;
+					}
+					for (const auto& move : step) {
+						applyMove(board, patterns, move);
+						moves.push_back(move);
+					}
+				}
+			}
+			return true;
+		}
 
-	Solution optimizedGreedy(const OptimizedBoard& initialBoard, const Array<Pattern>& patterns) {
-		OptimizedBoard board = initialBoard;
-		// Z字に進行(横書き文章の順)
-		// 3HWで解く
-		// 1番右の列を移動につかうことで3HWで解ける?
-		auto startTime = std::chrono::high_resolution_clock::now();
-		Solution solution;
-		while (!board.isGoal()) {
+	private:
+		struct Candidate {
+			int32 gain = 0;
+			int32 cost = 1;
+			int32 bit = 0;
+			int32 x = 0;
+			int32 dx = 0;
+		};
 
-			int32 progress = board.getCorrectCount();
-			int32 sy = progress / board.width, sx = progress % board.width;
+		// ゴールより多く入っているマスの数
+		static int32 excess(const std::array<int32, 4>& count, const std::array<int32, 4>& goalCount) {
+			int32 total = 0;
+			for (int32 v = 0; v < 4; ++v) total += Max(0, count[v] - goalCount[v]);
+			return total;
+		}
 
-			const auto& candidates = board.sortedFindPointsWithSameValueAndYPopcountDiff1(sx, sy);
+		// 区間の中身 removed を added に入れ替えたときに減る、余っているマスの数
+		static int32 gainOf(const std::array<int32, 4>& count, const std::array<int32, 4>& goalCount, int32 mismatch,
+			const std::array<int32, 4>& removed, const std::array<int32, 4>& added) {
+			std::array<int32, 4> next;
+			for (int32 v = 0; v < 4; ++v) next[v] = count[v] - removed[v] + added[v];
+			return mismatch - excess(next, goalCount);
+		}
 
-			Solution bestSolution;
-			double bestProgressDelta = 0;
+		// 手数あたりで一番減らせる持ち上げ方
+		// 回さない（1手）は区間の位置をすべて試し、回す（2手）は余りを一番多く含む区間についてだけ回し方をすべて試す
+		static Candidate findBest(const OptimizedBoard& board, int32 y, const std::array<int32, 4>& count,
+			const std::array<int32, 4>& goalCount, int32 mismatch) {
+			const int32 width = board.width;
+			Candidate best;
+			auto consider = [&](const Candidate& candidate) {
+				const int64 lhs = int64(candidate.gain) * best.cost, rhs = int64(best.gain) * candidate.cost;
+				if (lhs > rhs || (lhs == rhs && candidate.gain > best.gain)) best = candidate;
+			};
 
-			for (const auto& [nx, ny] : candidates) {
-				OptimizedBoard currentBoard = board;
-				// Console << U"nx, ny : " << Point(nx, ny);
-				Solution currentSolution;
-				const int32 dy = ny - sy, dx = nx - sx;
+			std::vector<int32> upper(width), lower(width);
+			for (int32 x = 0; x < width; ++x) upper[x] = board.getGrid(x, y);
 
-				if (dy == 0) {
-					const int bit = log2(dx);
-					const auto& pattern = bit == 0 ? patterns[0] : patterns[3 * (bit - 1) + 1];
-					currentBoard.apply_pattern(pattern, Point(sx, sy), 2);
-					currentSolution.steps.emplace_back(pattern, Point(sx, sy), 2);
+			for (int32 bit = 0; bit <= MaxPatternBit && y + (1 << bit) < board.height; ++bit) {
+				const int32 size = 1 << bit, ny = y + size;
+				for (int32 x = 0; x < width; ++x) lower[x] = board.getGrid(x, ny);
+				std::array<int32, 4> removed{}, added{};
+				for (int32 x = 0; x < Min(size, width); ++x) {
+					++removed[upper[x]];
+					++added[lower[x]];
 				}
-				else {
-					if (dx > 0) {
-						currentBoard.apply_pattern(patterns[22], Point(dx - 256, ny), 2);
-						currentSolution.steps.emplace_back(patterns[22], Point(dx - 256, ny), 2);
-					}
-					else if (dx < 0) {
-						currentBoard.apply_pattern(patterns[22], Point(dx + board.width, ny), 3);
-						currentSolution.steps.emplace_back(patterns[22], Point(dx + board.width, ny), 3);
-					}
 
+				int32 widest = 0, widestRemovable = -1;
+				for (int32 x = 0; x < width; ++x) {
+					if (x > 0) {
+						--removed[upper[x - 1]];
+						--added[lower[x - 1]];
+						if (x + size - 1 < width) {
+							++removed[upper[x + size - 1]];
+							++added[lower[x + size - 1]];
+						}
+					}
+					consider({ gainOf(count, goalCount, mismatch, removed, added), 1, bit, x, 0 });
 
-					if (dy > 0) {
-						const int bit = log2(dy);
-						const auto& pattern = bit == 0 ? patterns[0] : patterns[3 * (bit - 1) + 1];
-						currentBoard.apply_pattern(pattern, Point(sx, sy), 0);
-						currentSolution.steps.emplace_back(pattern, Point(sx, sy), 0);
+					int32 removable = 0;
+					for (int32 v = 0; v < 4; ++v) removable += Min(removed[v], Max(0, count[v] - goalCount[v]));
+					if (removable > widestRemovable) {
+						widestRemovable = removable;
+						widest = x;
 					}
 				}
-				if (currentSolution.steps.size() == 0) {
-					// Console << U"step size 0 " << Point(nx, ny);
-					continue;
-				}
-				double currentProgressDelta = double(currentBoard.getCorrectCount() - progress) / currentSolution.steps.size();
-				if (currentProgressDelta > bestProgressDelta) {
-					bestProgressDelta = currentProgressDelta;
-					bestSolution = currentSolution;
+
+				// widest の区間に、ny 行目を左に dx 回した区間を持ち上げる
+				const int32 length = Min(size, width - widest);
+				removed = {};
+				added = {};
+				for (int32 x = widest; x < widest + length; ++x) ++removed[upper[x]];
+				for (int32 i = 0; i < length; ++i) ++added[lower[(widest + i) % width]];
+				for (int32 dx = 1; dx < width; ++dx) {
+					--added[lower[(widest + dx - 1) % width]];
+					++added[lower[(widest + dx + length - 1) % width]];
+					consider({ gainOf(count, goalCount, mismatch, removed, added), 2, bit, widest, dx });
 				}
 			}
+			return best;
+		}
+	};
 
-			// 見つからなかったとき
-			if (bestSolution.steps.empty()) {
-				std::vector<std::pair<int, int>> targets;
-				int target = board.getGoal(sx, sy);
-				//　同じ行で探す
-				for (int nx = sx; nx < board.width; nx++) {
-					if (board.getGrid(nx, sy) == target) {
-						targets.emplace_back(nx, sy);
-					}
-				}
+	// 1行のボードの手を、盤面の一番上の行だけに効く手にする
+	// 型の最後の（1を含む）行を0行目に合わせ、それより上の行は盤面の外に出す。使っていた型の行と最後の行が同じでなければ false
+	bool liftToTopRow(const Pattern& pattern, Move& move) {
+		const auto& grid = pattern.grid;
+		const int32 row = -move.pos.y;
+		int32 last = static_cast<int32>(grid.height()) - 1;
+		auto empty = [&](int32 r) {
+			for (int32 x = 0; x < static_cast<int32>(grid.width()); ++x) if (grid[r][x] != 0) return false;
+			return true;
+		};
+		while (last > 0 && empty(last)) --last;
+		if (row < 0 || last < row) return false;
+		for (int32 x = 0; x < static_cast<int32>(grid.width()); ++x) {
+			if (grid[last][x] != grid[row][x]) return false;
+		}
+		move.pos.y = -last;
+		return true;
+	}
 
-				// 別の行( popcountで差が1じゃない行)
-				for (int ny = sy + 1; ny < board.height; ny++) {
-					for (int nx : step(board.width)) {
-						if (board.getGrid(nx, ny) != target) continue;
-						targets.emplace_back(nx, ny);
-					}
-				}
+	// 二段階法
+	// 1段目（RowBalancer）で各行の値の個数を揃えたら、2段目は横の手だけで各行を並べる
+	// 一番上の行だけに効く手で並べてから全体を1行上に回す、を H 回繰り返すと元の並びに戻るので、
+	// 行ごとの手順は互いに独立で、1行のボードの貪欲で並列に計画できる
+	Solution twoPhase(const Board& initialBoard, const Array<Pattern>& patterns, const Options& options) {
+		OptimizedBoard board(initialBoard.width, initialBoard.height, initialBoard.grid, initialBoard.goal);
+		auto startTime = std::chrono::high_resolution_clock::now();
 
-				for (const auto& [gx, gy] : targets) {
-					int dx = gx - sx, dy = gy - sy;
-					Solution currentSolution;
-					OptimizedBoard currentBoard = board;
-					if (dy > 0) {
-						if (dx > 0) {
-							currentSolution.steps.emplace_back(patterns[22], Point(dx - 256, sy + 1), 2);
-							currentBoard.apply_pattern(patterns[22], Point(dx - 256, sy + 1), 2);
-						}
-						else if (dx < 0) {
-							currentSolution.steps.emplace_back(patterns[22], Point(gx + (board.width - sx), sy + 1), 3);
-							currentBoard.apply_pattern(patterns[22], Point(gx + (board.width - sx), sy + 1), 3);
-						}
-						for (int bit : step(8)) {
-							if ((dy >> bit) & 1) {
-								const auto& pattern = (bit == 0) ? patterns[0] : patterns[3 * (bit - 1) + 1];
-								currentSolution.steps.emplace_back(pattern, Point(sx, sy), 0);
-								currentBoard.apply_pattern(pattern, Point(sx, sy), 0);
-							}
-						}
-					}
-					else {
-						for (int bit : step(8)) {
-							if ((dx >> bit) & 1) {
-								const auto& pattern = (bit == 0) ? patterns[0] : patterns[3 * (bit - 1) + 1];
-								currentSolution.steps.emplace_back(pattern, Point(sx, sy), 2);
-								currentBoard.apply_pattern(pattern, Point(sx, sy), 2);
-							}
-						}
-					}
+		const Deadline deadline(options);
+		Array<Move> moves;
+		// 揃えられなかったときは、行ごとに並べられないので貪欲法で解く
+		if (!RowBalancer::apply(board, patterns, moves, &deadline)) {
+			Console << U"row balancing failed, fallback to greedy";
+			return greedy(initialBoard, patterns, options);
+		}
+		const size_t balanceSteps = moves.size();
+
+		// 行の計画は定型抜き型だけを使う（一般抜き型は一番上の行だけに効くとは限らない）
+		const int32 height = board.height;
+		const int32 threads = solverThreads(options);
+		Array<Array<Move>> rowMoves(height);
+#pragma omp parallel for schedule(dynamic) num_threads(threads)
+		for (int32 y = 0; y < height; ++y) {
+			OptimizedBoard row = board.extractRow(y, y);
+			GreedyWorkspace workspace;
+			workspace.deadline = &deadline;
+			optimizedGreedy(row, patterns, rowMoves[y], workspace);
+		}
 
-					double currentProgressDelta = double(currentBoard.getCorrectCount() - progress) / currentSolution.steps.size();
-					// Console << U"best:{}, current:{}"_fmt(bestProgressDelta, currentProgressDelta);
-					if (currentProgressDelta > bestProgressDelta) {
-						bestProgressDelta = currentProgressDelta;
-						bestSolution = currentSolution;
+		// 全体を1行上に回す手（盤面より広いタイプⅠの最後の行で0行目を抜く）
+		const MoveTable moveTable(board.width, board.height);
+		const Move rotation{ moveTable.coverPatternIndex(), Point(0, 1 - moveTable.coverSize()), 0 };
+		if (!board.isGoal()) {
+			for (int32 y = 0; y < height; ++y) {
+				for (Move move : rowMoves[y]) {
+					if (!liftToTopRow(patterns[move.patternIndex], move)) {
+						Console << U"row move cannot be lifted to the top row, fallback to greedy";
+						return greedy(initialBoard, patterns, options);
 					}
+					moves.push_back(move);
 				}
+				moves.push_back(rotation);
 			}
-			for (const auto& action : bestSolution.steps) {
-				const auto& [pattern, point, direction] = action;
-				board.apply_pattern(pattern, point, direction);
-				solution.steps.emplace_back(action);
-				// Console << U"pattern:{}, Point:{}, direction:{}"_fmt(pattern.p, point, direction);
-			}
-
 		}
 
 		auto currentTime = std::chrono::high_resolution_clock::now();
 		double elapsedTime = std::chrono::duration<double>(currentTime - startTime).count();
+		Console << U"balance: " << balanceSteps << U" steps, align: " << (moves.size() - balanceSteps) << U" steps";
 		Console << elapsedTime << U"sec";
 
-		return solution;
+		return toSolution(moves, patterns);
 	}
 
-	// 行の入れ替えでも試してみる
-	Solution improveGreedy(const Board& initialBoard, const Array<Pattern>& patterns) {
-		const double TIME_LIMIT = 200.0;
-		auto startTime = std::chrono::high_resolution_clock::now();
+	// 並列 LNS のワーカーが共有の最良に追従する間隔（試行数）
+	constexpr int64_t ResyncInterval = 16;
 
-		Solution bestSolution = greedy(initialBoard, patterns);
-		int bestStepCount = bestSolution.steps.size();
+	// 手順の途中の盤面を Interval 手ごとに詰めた形で持っておき、途中からの再生を速くする
+	// 先頭 count 手の後の盤面は、直前のスナップショットから高々 Interval 手の適用で作れる
+	class CheckpointedReplay {
+	public:
+		static constexpr size_t Interval = 32;
 
-		int64_t totalTrials = 0;  // 試行回数カウンター
+		// moves の from 手目以降が変わったときに、そこから先のスナップショットだけ作り直す
+		void rebuild(const OptimizedBoard& startBoard, const Array<Pattern>& patterns, const Array<Move>& moves, size_t from) {
+			if (m_snapshots.empty()) {
+				m_snapshots.push_back(startBoard.packedGrid());
+			}
+			const size_t kept = Min(m_snapshots.size(), from / Interval + 1);
+			m_snapshots.resize(kept);
+
+			m_work = startBoard;
+			m_work.restorePackedGrid(m_snapshots.back());
+			for (size_t i = (kept - 1) * Interval; i < moves.size(); ++i) {
+				applyMove(m_work, patterns, moves[i]);
+				if ((i + 1) % Interval == 0) {
+					m_snapshots.push_back(m_work.packedGrid());
+				}
+			}
+		}
 
-		auto currentTime = std::chrono::high_resolution_clock::now();
-		double elapsedTime = std::chrono::duration<double>(currentTime - startTime).count();
+		// moves の先頭 count 手を適用した盤面を board に作る
+		void restore(OptimizedBoard& board, const Array<Pattern>& patterns, const Array<Move>& moves, size_t count) const {
+			const size_t index = Min(count / Interval, m_snapshots.size() - 1);
+			board.restorePackedGrid(m_snapshots[index]);
+			for (size_t i = index * Interval; i < count; ++i) {
+				applyMove(board, patterns, moves[i]);
+			}
+		}
 
-		while (elapsedTime < TIME_LIMIT) {
-			totalTrials++;  // 試行回数をインクリメント
+	private:
+		// m_snapshots[k] = k * Interval 手の後の盤面
+		std::vector<std::vector<uint64_t>> m_snapshots;
+		OptimizedBoard m_work{ 1, 1 };
+	};
 
-			Solution candidateSolution = bestSolution;
-			if (candidateSolution.steps.empty()) continue;
+	// 並列 LNS で共有する最良の手順
+	// 書き込まれた手順は探索が終わるまで解放しないので、読み手はロックなしで load() した手順を使える
+	// 書き込みは「今の最良より短いときだけ」の CAS で、ロックを取らない
+	class BestSolutionRegister {
+	public:
+		explicit BestSolutionRegister(Array<Move> initialMoves)
+			: m_best(new Entry{ std::move(initialMoves), nullptr }) {}
+
+		~BestSolutionRegister() {
+			for (const Entry* entry = m_best.load(); entry != nullptr;) {
+				const Entry* previous = entry->previous;
+				delete entry;
+				entry = previous;
+			}
+		}
 
-			int changePos = rand() % candidateSolution.steps.size();
+		BestSolutionRegister(const BestSolutionRegister&) = delete;
+		BestSolutionRegister& operator=(const BestSolutionRegister&) = delete;
 
-			OptimizedBoard tempBoard(initialBoard.width, initialBoard.height, initialBoard.grid, initialBoard.goal);
-			Solution newSolution;
+		const Array<Move>& load() const {
+			return m_best.load(std::memory_order_acquire)->moves;
+		}
 
-			for (int i = 0; i < changePos; i++) {
-				const auto& [pattern, point, dir] = candidateSolution.steps[i];
-				tempBoard.apply_pattern(pattern, point, dir);
-				newSolution.steps.emplace_back(pattern, point, dir);
+		size_t size() const {
+			return load().size();
+		}
+
+		// moves が今の最良より短ければ書き込んで true
+		bool publish(const Array<Move>& moves) {
+			const Entry* current = m_best.load(std::memory_order_acquire);
+			if (moves.size() >= current->moves.size()) return false;
+			Entry* entry = new Entry{ moves, current };
+			while (moves.size() < current->moves.size()) {
+				entry->previous = current;
+				if (m_best.compare_exchange_weak(current, entry, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					return true;
+				}
 			}
+			delete entry;
+			return false;
+		}
 
-			int patternIndex = 23;
-			int currentProgress = tempBoard.getCorrectCount();
-			int currentX = currentProgress % tempBoard.width, currentY = currentProgress / tempBoard.width;
-			int direction = 0;
-			int y = currentY;
-			int x = Random<int>(currentX, initialBoard.width - 1);
-			if (tempBoard.compareRows(x, y, x, y + 1) < tempBoard.compareRows(x, y, x, y)) {
-				continue;
+	private:
+		struct Entry {
+			Array<Move> moves;
+			const Entry* previous;
+		};
+		std::atomic<const Entry*> m_best;
+	};
+
+	// 改善貪欲（並列 LNS）
+	// 各ワーカーが最良の手順をランダムな位置で切り、近傍の1手を入れてから貪欲で作り直す
+	// 近傍は「行の入れ替え（タイプⅡで1行おきに抜く）」を 3/4、「貪欲が選ばなかった候補を1つ選ぶ」を 1/4 の割合で使う
+	// 短くなったら共有の最良に書き込み、各ワーカーは定期的に共有の最良に追従する
+	Solution improveGreedy(const Board& initialBoard, const Array<Pattern>& patterns, const Options& options) {
+		PROFILE_ZONE("improveGreedy");
+		const Deadline deadline(options.timeLimit > 0 ? options.timeLimit : DefaultTimeLimit, options.cancel);
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		const OptimizedBoard startBoard(initialBoard.width, initialBoard.height, initialBoard.grid, initialBoard.goal);
+		const MoveTable moveTable(startBoard.width, startBoard.height);
+		const GeneralPatternIndex general(patterns);
+
+		Array<Move> initialMoves;
+		{
+			GreedyWorkspace workspace;
+			workspace.deadline = &deadline;
+			workspace.general = &general;
+			workspace.threads = solverThreads(options);
+			OptimizedBoard board = startBoard;
+			optimizedGreedy(board, patterns, initialMoves, workspace);
+		}
+		BestSolutionRegister best(std::move(initialMoves));
+
+		const uint64 seed = runSeed(options);
+		const int32 workerCount = solverThreads(options);
+		std::atomic<int64_t> totalTrials = 0;  // 試行回数カウンター
+		std::atomic<int64_t> prunedTrials = 0;  // 下界で打ち切った試行
+		std::atomic<int64_t> planLookups = 0, planHits = 0;  // 行の手順の記録を引いた回数・当たった回数
+		std::mutex consoleMutex;
+
+		auto worker = [&](int32 workerIndex) {
+			PROFILE_ZONE("improveGreedy/worker");
+			GreedyWorkspace workspace;
+			workspace.deadline = &deadline;
+			workspace.abandonOnDeadline = true;
+			RowPlanCache rowPlans;
+			workspace.rowPlans = &rowPlans;
+			workspace.general = &general;
+			SearchBuffer buffer;
+			Array<MoveList> legalActions;
+			SolverRandom rng(seed, workerIndex);
+
+			// 試行ごとに使い回す盤面と手順
+			OptimizedBoard tempBoard = startBoard;
+			Array<Move> newMoves;
+
+			// 追従している最良の手順と、その途中の盤面
+			Array<Move> localMoves = best.load();
+			CheckpointedReplay replay;
+			replay.rebuild(startBoard, patterns, localMoves, 0);
+
+			for (int64_t trial = 1; !deadline.expired(); ++trial) {
+				// 他のワーカーの改善に追従
+				if (trial % ResyncInterval == 0 && best.size() < localMoves.size()) {
+					localMoves = best.load();
+					replay.rebuild(startBoard, patterns, localMoves, 0);
+				}
+				if (localMoves.empty()) break;
+				++totalTrials;
+				PROFILE_ZONE("improveGreedy/trial");
+
+				const int changePos = static_cast<int>(rng.below(static_cast<uint32>(localMoves.size())));
+				newMoves.assign(localMoves.begin(), localMoves.begin() + changePos);
+				replay.restore(tempBoard, patterns, localMoves, changePos);
+
+				const int currentProgress = tempBoard.getCorrectCount();
+				const int currentX = currentProgress % tempBoard.width, currentY = currentProgress / tempBoard.width;
+
+				if (rng.below(4) != 0) {
+					// 行の入れ替え
+					const int y = currentY;
+					const int x = currentX + static_cast<int>(rng.below(tempBoard.width - currentX));
+					if (tempBoard.compareRows(x, y, x, y + 1) < tempBoard.compareRows(x, y, x, y)) {
+						continue;
+					}
+					const Move move{ moveTable.evenRowCoverPatternIndex(), Point(x, y), 0 };
+					applyMove(tempBoard, patterns, move);
+					newMoves.push_back(move);
+				}
+				else {
+					// 候補を1つ選んで進める
+					optimizedNextState(tempBoard, buffer, legalActions, &general);
+					if (legalActions.empty()) continue;
+					for (const auto& move : legalActions[rng.below(static_cast<uint32>(legalActions.size()))]) {
+						applyMove(tempBoard, patterns, move);
+						newMoves.push_back(move);
+					}
+				}
+
+				// 共有の最良より短くなりえなくなった時点で打ち切る
+				if (!optimizedGreedy(tempBoard, patterns, newMoves, workspace, best.size())) {
+					++prunedTrials;
+				}
+				else if (best.publish(newMoves)) {
+					localMoves = newMoves;
+					// changePos 手目までは前の最良と同じ
+					replay.rebuild(startBoard, patterns, localMoves, changePos);
+					std::lock_guard lock(consoleMutex);
+					Console << U"Improved! Steps: " << newMoves.size() << U", Trials: " << totalTrials.load() << U", Worker: " << workerIndex;
+				}
 			}
+			planLookups += rowPlans.lookups();
+			planHits += rowPlans.hits();
+		};
 
-			tempBoard.apply_pattern(patterns[patternIndex], Point(x, y), direction);
-			newSolution.steps.emplace_back(patterns[patternIndex], Point(x, y), direction);
+		std::vector<std::thread> threads;
+		for (int32 i = 0; i < workerCount; ++i) {
+			threads.emplace_back(worker, i);
+		}
+		for (auto& thread : threads) thread.join();
+
+		const auto currentTime = std::chrono::high_resolution_clock::now();
+		const double elapsedTime = std::chrono::duration<double>(currentTime - startTime).count();
 
-			OptimizedBoard remainingBoard = tempBoard;
-			Solution remainingSolution = optimizedGreedy(remainingBoard, patterns);
+		Console << U"Workers: " << workerCount << U", Seed: " << seed;
+		Console << U"Total trials: " << totalTrials.load();
+		Console << U"Pruned trials: " << prunedTrials.load();
+		Console << U"Row plan hits: " << planHits.load() << U" / " << planLookups.load();
+		Console << U"Final step count: " << best.size();
+		Console << U"Time taken: " << elapsedTime << U" seconds";
+		Console << U"Trials per second: " << (double)totalTrials.load() / elapsedTime;
+		if (options.stats) options.stats->trials += totalTrials.load();
+		return toSolution(best.load(), patterns);
+	}
+
+
+	// 解を初期盤面に適用してゴールに着くか確かめる
+	// OptimizedBoard の誤りを見逃さないよう、ビジュアライザと同じ Board で再生する
+	bool isValidSolution(const Board& initialBoard, const Solution& solution) {
+		Board check = initialBoard;
+		for (const auto& [pattern, pos, direction] : solution.steps) {
+			check.apply_pattern(pattern, pos, direction);
+		}
+		return check.is_goal();
+	}
 
-			for (const auto& step : remainingSolution.steps) {
-				newSolution.steps.emplace_back(step);
+	// 盤面の対称変換
+	enum class Symmetry {
+		Identity,
+		Transpose,		// (x, y) -> (y, x)
+		FlipHorizontal,	// (x, y) -> (W - 1 - x, y)
+		FlipVertical,	// (x, y) -> (x, H - 1 - y)
+	};
+
+	// 定型抜き型のタイプ（0: タイプⅠ, 1: タイプⅡ, 2: タイプⅢ）
+	constexpr int32 standardPatternType(int32 patternIndex) {
+		return patternIndex == 0 ? 0 : (patternIndex - 1) % 3;
+	}
+
+	// 変換した問題を作る
+	Board transformBoard(const Board& board, Symmetry symmetry) {
+		const bool transposed = symmetry == Symmetry::Transpose;
+		Board result(transposed ? board.height : board.width, transposed ? board.width : board.height);
+		for (int32 y = 0; y < board.height; ++y) {
+			for (int32 x = 0; x < board.width; ++x) {
+				int32 tx = x, ty = y;
+				switch (symmetry) {
+				case Symmetry::Transpose: tx = y; ty = x; break;
+				case Symmetry::FlipHorizontal: tx = board.width - 1 - x; break;
+				case Symmetry::FlipVertical: ty = board.height - 1 - y; break;
+				default: break;
+				}
+				result.grid[ty][tx] = board.grid[y][x];
+				result.goal[ty][tx] = board.goal[y][x];
 			}
+		}
+		return result;
+	}
+
+	// 変換した問題での1手を元の問題（幅 width, 高さ height）の1手に戻す
+	// 定型抜き型は反転・転置しても（位置を1ずらせば）定型抜き型になるが、一般抜き型は戻せないので false（変換なしはそのまま）
+	bool mapStepBack(const std::tuple<Pattern, Point, int32>& step, Symmetry symmetry, int32 width, int32 height,
+		const Array<Pattern>& patterns, std::tuple<Pattern, Point, int32>& result) {
+		if (symmetry == Symmetry::Identity) {
+			result = step;
+			return true;
+		}
+		const auto& [pattern, pos, direction] = step;
+		if (pattern.p < 0 || StandardPatternCount <= pattern.p) return false;
+
+		const int32 type = standardPatternType(pattern.p);
+		const int32 size = static_cast<int32>(pattern.grid.width());
+		int32 patternIndex = pattern.p;
+		Point originalPos = pos;
+		int32 originalDirection = direction;
+
+		switch (symmetry) {
+		case Symmetry::Transpose:
+			// 行と列が入れ替わるので、タイプⅡとタイプⅢ、上と左、下と右が入れ替わる
+			if (type == 1) patternIndex += 1;
+			if (type == 2) patternIndex -= 1;
+			originalPos = Point(pos.y, pos.x);
+			originalDirection = direction ^ 2;
+			break;
+		case Symmetry::FlipHorizontal:
+			// 偶数列を反転すると奇数列になるので、タイプⅢは1つ右にずらす
+			originalPos.x = width - pos.x - size + (type == 2 ? 1 : 0);
+			if (direction >= 2) originalDirection = direction ^ 1;
+			break;
+		case Symmetry::FlipVertical:
+			// 同じく、タイプⅡは1つ下にずらす
+			originalPos.y = height - pos.y - size + (type == 1 ? 1 : 0);
+			if (direction <= 1) originalDirection = direction ^ 1;
+			break;
+		default:
+			break;
+		}
+
+		result = { patterns[patternIndex], originalPos, originalDirection };
+		return true;
+	}
 
-			if (newSolution.steps.size() < bestStepCount) {
-				bestSolution = newSolution;
-				bestStepCount = newSolution.steps.size();
-				Console << U"Improved! Steps: " << bestStepCount << U", Trials: " << totalTrials;
+	// 元の問題・転置・左右反転・上下反転をそれぞれ別スレッドで解き、元に戻して検証できた中で最短の解を返す
+	Solution solveOrientations(Type algorithmType, const Board& initialBoard, const Array<Pattern>& patterns, Options options) {
+		options.orientations = false;
+		constexpr std::array<Symmetry, 4> symmetries = {
+			Symmetry::Identity, Symmetry::Transpose, Symmetry::FlipHorizontal, Symmetry::FlipVertical
+		};
+		constexpr std::array<const char32_t*, 4> symmetryNames = { U"Identity", U"Transpose", U"FlipHorizontal", U"FlipVertical" };
+
+		std::array<Solution, symmetries.size()> solutions;
+		std::array<bool, symmetries.size()> verified{};
+		std::vector<std::thread> threads;
+
+		// 4つの向きでコアを分け合う
+		Options variantOptions = options;
+		variantOptions.threads = Max(1, solverThreads(options) / static_cast<int32>(symmetries.size()));
+
+		auto solveVariant = [&](size_t i) {
+			// 一般抜き型は変換した問題の手を元に戻せないので、変換した問題では定型抜き型だけを使う
+			const Board variant = transformBoard(initialBoard, symmetries[i]);
+			const Array<Pattern> variantPatterns = symmetries[i] == Symmetry::Identity ? patterns : patterns.take(StandardPatternCount);
+			const Solution solution = solve(algorithmType, variant, variantPatterns, variantOptions);
+
+			Solution& mapped = solutions[i];
+			mapped.steps.reserve(solution.steps.size());
+			for (const auto& step : solution.steps) {
+				std::tuple<Pattern, Point, int32> originalStep = step;
+				if (!mapStepBack(step, symmetries[i], initialBoard.width, initialBoard.height, patterns, originalStep)) return;
+				mapped.steps.push_back(originalStep);
 			}
+			verified[i] = isValidSolution(initialBoard, mapped);
+		};
 
-			currentTime = std::chrono::high_resolution_clock::now();
-			elapsedTime = std::chrono::duration<double>(currentTime - startTime).count();
+		for (size_t i = 0; i < symmetries.size(); ++i) {
+			threads.emplace_back([&, i]() {
+				// スレッドの外に例外を出さない（解けなかった向きは検証に落ちた扱い）
+				// ヘッドレス版の Error は std::exception を継承しないので、両方を受ける
+				try {
+					solveVariant(i);
+				}
+				catch (const Error&) {
+					verified[i] = false;
+				}
+				catch (const std::exception&) {
+					verified[i] = false;
+				}
+			});
 		}
+		for (auto& thread : threads) thread.join();
 
-		Console << U"Total trials: " << totalTrials;
-		Console << U"Final step count: " << bestStepCount;
-		Console << U"Time taken: " << elapsedTime << U" seconds";
-		Console << U"Trials per second: " << (double)totalTrials / elapsedTime;
-		return bestSolution;
+		size_t best = symmetries.size();
+		for (size_t i = 0; i < symmetries.size(); ++i) {
+			Console << U"{}: {} steps{}"_fmt(symmetryNames[i], solutions[i].steps.size(), verified[i] ? U"" : U" (rejected)");
+			if (verified[i] && (best == symmetries.size() || solutions[i].steps.size() < solutions[best].steps.size())) {
+				best = i;
+			}
+		}
+		if (best == symmetries.size()) {
+			throw Error(U"No orientation produced a valid solution");
+		}
+		return solutions[best];
 	}
 
+	// 貪欲・ビームサーチ・改善貪欲を同じ締め切りで並列に走らせ、検証できた中で最短の解を返す
+	// 締め切りか外からの中止で全員に中止フラグを立て、各アルゴリズムは手持ちの最良で切り上げる
+	Solution solvePortfolio(const Board& initialBoard, const Array<Pattern>& patterns, Options options) {
+		constexpr std::array<Type, 3> members = { Type::Greedy, Type::BeamSearch, Type::ImprovedGreedy };
+		constexpr std::array<const char32_t*, 3> memberNames = { U"Greedy", U"BeamSearch", U"ImprovedGreedy" };
+
+		const double timeLimit = options.timeLimit > 0 ? options.timeLimit : DefaultTimeLimit;
+		const Deadline deadline(timeLimit, options.cancel);
+		std::atomic<bool> stop = false;
+		options.timeLimit = timeLimit;
+		options.cancel = &stop;
+
+		// 全員が全コアを使うと取り合いになるので、貪欲とビームサーチに1つずつ、残りを改善貪欲に割り当てる
+		std::array<Options, 3> memberOptions = { options, options, options };
+		memberOptions[0].threads = 1;
+		memberOptions[1].threads = 1;
+		memberOptions[2].threads = Max(1, solverThreads(options) - 2);
+
+		std::array<Solution, members.size()> solutions;
+		std::array<bool, members.size()> solved{};
+		std::atomic<int32> running = static_cast<int32>(members.size());
+		std::vector<std::thread> threads;
+
+		for (size_t i = 0; i < members.size(); ++i) {
+			threads.emplace_back([&, i]() {
+				// スレッドの外に例外を出さない（解けなかった手法は検証に落ちた扱い）
+				// ヘッドレス版の Error は std::exception を継承しないので、両方を受ける
+				try {
+					solutions[i] = solve(members[i], initialBoard, patterns, memberOptions[i]);
+					solved[i] = true;
+				}
+				catch (const Error&) {
+					solved[i] = false;
+				}
+				catch (const std::exception&) {
+					solved[i] = false;
+				}
+				--running;
+			});
+		}
+
+		// 締め切りか外からの中止を全員に伝える
+		while (running > 0) {
+			if (deadline.expired()) stop = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		for (auto& thread : threads) thread.join();
+
+		// 検証は盤面の大きさと手数に比例して重いので、短い順に調べて最初に通ったものを返す
+		std::array<size_t, members.size()> order;
+		std::iota(order.begin(), order.end(), size_t(0));
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return solutions[a].steps.size() < solutions[b].steps.size();
+		});
+		for (const size_t i : order) {
+			if (!solved[i]) continue;
+			const bool valid = isValidSolution(initialBoard, solutions[i]);
+			Console << U"{}: {} steps{}"_fmt(memberNames[i], solutions[i].steps.size(), valid ? U"" : U" (rejected)");
+			if (valid) return solutions[i];
+		}
+		throw Error(U"No algorithm produced a valid solution");
+	}
+
+	PlacementScores scorePlacements(const Board& board, const Pattern& pattern, int32 direction) {
+		PlacementScores result;
+		result.offset = Point(pattern.grid.width() - 1, pattern.grid.height() - 1);
+
+		if (direction >= 2) {
+			const OptimizedBoard optimized(board.width, board.height, board.grid, board.goal);
+			result.matches = PlacementScorer::horizontal(optimized, pattern.grid, direction);
+			return result;
+		}
+
+		// 縦向きは転置して横向きとして数える（上は左、下は右になる）
+		Grid<int32> grid(board.height, board.width), goal(board.height, board.width);
+		for (int32 y = 0; y < board.height; ++y) {
+			for (int32 x = 0; x < board.width; ++x) {
+				grid[x][y] = board.grid[y][x];
+				goal[x][y] = board.goal[y][x];
+			}
+		}
+		const int32 patternWidth = static_cast<int32>(pattern.grid.width()), patternHeight = static_cast<int32>(pattern.grid.height());
+		Grid<int32> transposedPattern(patternHeight, patternWidth);
+		for (int32 y = 0; y < patternHeight; ++y) {
+			for (int32 x = 0; x < patternWidth; ++x) {
+				transposedPattern[x][y] = pattern.grid[y][x];
+			}
+		}
+		const OptimizedBoard optimized(board.height, board.width, grid, goal);
+		const Grid<int32> transposed = PlacementScorer::horizontal(optimized, transposedPattern, direction + 2);
+		const int32 columns = static_cast<int32>(transposed.width()), rows = static_cast<int32>(transposed.height());
+		result.matches = Grid<int32>(rows, columns);
+		for (int32 y = 0; y < rows; ++y) {
+			for (int32 x = 0; x < columns; ++x) {
+				result.matches[x][y] = transposed[y][x];
+			}
+		}
+		return result;
+	}
+
+	Array<std::pair<Point, int32>> PlacementScores::top(size_t k) const {
+		Array<std::pair<Point, int32>> positions;
+		positions.reserve(static_cast<size_t>(matches.width()) * matches.height());
+		for (int32 y = 0; y < static_cast<int32>(matches.height()); ++y) {
+			for (int32 x = 0; x < static_cast<int32>(matches.width()); ++x) {
+				positions.emplace_back(Point(x - offset.x, y - offset.y), matches[y][x]);
+			}
+		}
+		k = Min(k, positions.size());
+		std::partial_sort(positions.begin(), positions.begin() + k, positions.end(), [](const auto& a, const auto& b) {
+			return a.second > b.second;
+		});
+		positions.resize(k);
+		return positions;
+	}
+
+	Solution solve(Type algorithmType, const Board& initialBoard, const Array<Pattern>& patterns, const Options& options) {
+		if (options.orientations) {
+			return solveOrientations(algorithmType, initialBoard, patterns, options);
+		}
 
-	Solution solve(Type algorithmType, const Board& initialBoard, const Array<Pattern>& patterns) {
 		switch (algorithmType) {
 		case Type::Greedy:
-			return greedy(initialBoard, patterns);
+			return greedy(initialBoard, patterns, options);
 
 		case Type::BeamSearch:
-			return beamSearch(initialBoard, patterns);
+			return beamSearch(initialBoard, patterns, options);
 
 		case Type::ImprovedGreedy:
-			return improveGreedy(initialBoard, patterns);
+			return improveGreedy(initialBoard, patterns, options);
+
+		case Type::Portfolio:
+			return solvePortfolio(initialBoard, patterns, options);
+
+		case Type::TwoPhase:
+			return twoPhase(initialBoard, patterns, options);
 		default:
 			throw Error(U"Unknown algorithm type");
 		}
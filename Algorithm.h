@@ -1,7 +1,8 @@
 ﻿// algorithm.hpp
 
 #pragma once
-#include <Siv3D.hpp>
+#include "Core.h"
+#include <atomic>
 #include "Board.h"
 #include "Pattern.h"
 
@@ -10,7 +11,52 @@ namespace Algorithm {
 	enum class Type {
 		Greedy,
 		BeamSearch,
-		ImprovedGreedy
+		ImprovedGreedy,
+		// 上の3つを並列に走らせて最良を使う
+		Portfolio,
+		// 縦の手で各行の値の個数を揃えてから、行ごとに並列に横の手で並べる
+		TwoPhase
+	};
+
+	// 探索の統計（Options::stats に渡すと書き込まれる。並列に解くときは全員分をまとめる）
+	struct SolverStats {
+		// 改善貪欲の試行数
+		std::atomic<int64> trials{ 0 };
+		// ビームサーチの状態が使ったメモリの最大（バイト）
+		std::atomic<size_t> peakStateBytes{ 0 };
+	};
+
+	// 探索の設定
+	struct Options {
+		// 貪欲・ビームサーチの前に、行を丸ごと並べ替える事前処理をする
+		bool rowPlacement = false;
+
+		// 転置・左右反転・上下反転した問題も並列に解き、最短の解を使う
+		bool orientations = false;
+
+		// 制限時間（秒）。0 以下なら各アルゴリズムの既定値（改善貪欲・ポートフォリオは200秒、他は無制限）
+		// 締め切りを過ぎても返す解は必ず盤面を揃える：改善貪欲は手持ちの最良を、ビームサーチは貪欲の解を返し、
+		// 貪欲（二段階法の中で使うものも含む）は候補を比べるのをやめて、一番安く運べるマスを順に持ってきて最後まで揃える
+		// そのため、大きな盤面では仕上げの分だけ制限時間を超えることがある（256×256 で数秒）
+		double timeLimit = 0.0;
+
+		// 外から立てると、探索を手持ちの最良で切り上げる（nullptr なら使わない）
+		const std::atomic<bool>* cancel = nullptr;
+
+		// 改善貪欲のワーカー数。0 以下なら論理コア数
+		int32 threads = 0;
+
+		// ビームサーチの1層に残す状態の数。0 以下なら既定値（20）
+		int32 beamWidth = 0;
+
+		// ビームサーチの状態に使うメモリの上限（バイト）。超えそうなら幅を絞る。0 なら無制限
+		size_t beamMemoryBudget = 0;
+
+		// 乱数の種。同じ種なら各ワーカーは同じ乱数列を使う（0 ならその都度作る）
+		uint64 seed = 0;
+
+		// 統計の書き込み先（nullptr なら集めない）
+		SolverStats* stats = nullptr;
 	};
 
 	struct Solution {
@@ -18,7 +64,8 @@ namespace Algorithm {
 		Array<std::tuple<Pattern, Point, int32>> steps;
 		int32 score = 0;
 		Grid<int32> grid = Grid<int32>();
-		void outuputToJson() const {
+		// 提出用の JSON（{"n": 手数, "ops": [{"p", "x", "y", "s"}, ...]}）
+		JSON toJSON() const {
 			JSON output;
 			output[U"n"] = static_cast<int32>(steps.size());
 			Array<JSON> ops;
@@ -34,6 +81,24 @@ namespace Algorithm {
 			}
 
 			output[U"ops"] = ops;
+			return output;
+		}
+
+		// 提出用の JSON から読む（"p" は patterns の添字）
+		static Solution fromJSON(const JSON& json, const Array<Pattern>& patterns) {
+			Solution solution;
+			for (const auto& stepJson : json[U"ops"].arrayView()) {
+				const int32 p = stepJson[U"p"].get<int32>();
+				if (p < 0 || static_cast<int32>(patterns.size()) <= p) {
+					throw Error(U"Unknown pattern in answer JSON");
+				}
+				solution.steps.emplace_back(patterns[p], Point(stepJson[U"x"].get<int32>(), stepJson[U"y"].get<int32>()), stepJson[U"s"].get<int32>());
+			}
+			return solution;
+		}
+
+		void outuputToJson() const {
+			const JSON output = toJSON();
 			Console << U"Writing ...";
 			output.save(U"output.json");
 			Console << U"Wrote ";
@@ -54,15 +119,39 @@ namespace Algorithm {
 		}
 	};
 
+	// 1つの抜き型・方向を盤面のすべての位置に置いたときの評価
+	struct PlacementScores {
+		// matches[y + offset.y][x + offset.x] = 左上を (x, y) に置いたあと、ゴールと一致しているマスの数
+		Grid<int32> matches;
+		// 置ける位置は (-offset.x, -offset.y) から（offset = 抜き型の大きさ - 1）
+		Point offset = Point(0, 0);
+
+		int32 at(const Point& pos) const {
+			return matches[pos.y + offset.y][pos.x + offset.x];
+		}
+
+		// 一致数の多い順に k 個の位置と一致数
+		Array<std::pair<Point, int32>> top(size_t k) const;
+	};
+
+	// 抜き型の置き方すべてを1回でまとめて評価する（盤面のコピーや適用はしない）
+	// 方向は 0: 上, 1: 下, 2: 左, 3: 右
+	PlacementScores scorePlacements(const Board& board, const Pattern& pattern, int32 direction);
+
+
 	// 貪欲
-	Solution greedy(const Board& initialBoard, const Array<Pattern>& patterns);
+	Solution greedy(const Board& initialBoard, const Array<Pattern>& patterns, const Options& options = {});
 
 
 	// ビームサーチ
-	Solution beamSearch(const Board& initialBoard, const Array<Pattern>& patterns);
+	Solution beamSearch(const Board& initialBoard, const Array<Pattern>& patterns, const Options& options = {});
+
+
+	Solution solve(Type algorithmType, const Board& initialBoard, const Array<Pattern>& patterns, const Options& options = {});
 
 
-	Solution solve(Type algorithmType, const Board& initialBoard, const Array<Pattern>& patterns);
+	// 解を初期盤面に適用してゴールに着くか確かめる
+	bool isValidSolution(const Board& initialBoard, const Solution& solution);
 
 
 }
@@ -35,6 +35,28 @@ Board Board::fromJSON(const JSON& json) {
 	return board;
 }
 
+// JSONに書き出す（各行を "0123" のような文字列にする）
+JSON Board::toJSON() const {
+	auto rows = [&](const Grid<int32>& cells) {
+		Array<String> result;
+		for (int32 y = 0; y < height; ++y) {
+			String row;
+			for (int32 x = 0; x < width; ++x) {
+				row.push_back(static_cast<char32_t>(U'0' + cells[y][x]));
+			}
+			result << row;
+		}
+		return result;
+	};
+
+	JSON json;
+	json[U"width"] = width;
+	json[U"height"] = height;
+	json[U"start"] = rows(grid);
+	json[U"goal"] = rows(goal);
+	return json;
+}
+
 // ゴールかどうか
 bool Board::is_goal() const {
 	return grid == goal;
@@ -92,6 +114,7 @@ Board Board::applyPatternCopy(const Pattern& pattern, Point pos, int32 direction
 	return newBoard;
 }
 
+#ifndef PROCON_HEADLESS
 // siv3dのUIに描画
 void Board::draw() const {
 
@@ -125,6 +148,7 @@ void Board::draw() const {
 	Rect(0, 0, width * cellSize, height * cellSize).drawFrame(2, frameColor);
 
 }
+#endif
 
 // 上向き適用
 void Board::shift_up(const Grid<bool>& isRemoved) {
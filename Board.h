@@ -1,7 +1,7 @@
 ﻿#pragma once
 // Board.hpp
 
-#include <Siv3D.hpp>
+#include "Core.h"
 #include "Pattern.h"
 
 /**
@@ -35,6 +35,12 @@ public:
 	 */
 	static Board fromJSON(const JSON& json);
 
+	/**
+	 * @brief 盤面をJSONデータに変換
+	 * @return JSON fromJSON で読める形式（width, height, start, goal）
+	 */
+	JSON toJSON() const;
+
 	/**
 	 * @brief ゴール判定
 	 * @return true 目標の盤面と一致している場合
@@ -50,11 +56,13 @@ public:
 	 */
 	void apply_pattern(const Pattern& pattern, Point pos, int32 direction);
 
+#ifndef PROCON_HEADLESS
 	/**
 	 * @brief Siv3Dの描画処理
 	 * @details 現在の盤面をSiv3Dで描画します。
 	 */
 	void draw() const;
+#endif
 
 	/**
 	 * @brief ゴール状態との差異を計算
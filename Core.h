@@ -0,0 +1,10 @@
+﻿// Core.h
+// 盤面・抜き型・Algorithm（GUI に依存しない部分）が使う共通ヘッダ
+// PROCON_HEADLESS を定義したビルドでは Siv3D の代わりに Headless/Siv3DCompat.h を使う
+
+#pragma once
+#ifdef PROCON_HEADLESS
+#include "Headless/Siv3DCompat.h"
+#else
+#include <Siv3D.hpp>
+#endif
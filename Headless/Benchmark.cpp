@@ -0,0 +1,400 @@
+﻿// Benchmark.cpp
+// すべてのアルゴリズムを固定の問題集（種つきで生成）で解き、時間・手数・試行速度・メモリを JSON のレポートに書く
+// 前回のレポートを渡すと、問題とアルゴリズムごとに手数と時間を比べる
+//
+// 使い方: procon_bench [オプション]
+//   -o, --output <パス>      レポートの出力先（既定 bench_report.json）
+//   -b, --baseline <パス>    比べる前回のレポート
+//   -a, --algorithms <名前>  カンマ区切り（既定はすべて）
+//   -c, --cases <文字列>     名前にこの文字列を含む問題だけ解く
+//   -t, --time <秒>          時間いっぱい改善するアルゴリズム（greedy2 / portfolio）の制限時間（既定 10）
+//   -j, --threads <n>        スレッド数（0 なら論理コア数）
+//   --quick                  一辺 64 以下の問題だけ、制限時間 2 秒
+//   --tolerance <%>          前回より手数がこの割合を超えて増えたら退行（既定 0）
+//   --time-tolerance <%>     前回より時間がこの割合を超えて増えたら「遅くなった」と表示（既定 10）
+//   -v, --verbose            ソルバの途中経過を標準エラーに出す
+//
+// 不正な解があったとき、前回より手数が増えた・解けなくなったときは終了コード 1
+
+#include "Core.h"
+#include "Pattern.h"
+#include "StandardPatterns.h"
+#include "Board.h"
+#include "Algorithm.h"
+#include "ProblemGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <thread>
+
+namespace {
+
+	struct AlgorithmEntry {
+		const char32_t* name;
+		Algorithm::Type type;
+		// 制限時間いっぱいまで改善する（制限時間を渡す）
+		bool anytime;
+		// これより多いマスの問題は解かない（0 なら制限なし）
+		int32 maxCells;
+		// 改善の試行回数を数える（数えないものは試行速度を出さない）
+		bool countsTrials;
+	};
+
+	// 名前は procon_solver と同じ
+	// ビームサーチは時間で打ち切ると解が完成しないので、時間のかかる大きな盤面では解かない
+	constexpr std::array<AlgorithmEntry, 5> Algorithms = { {
+		{ U"greedy", Algorithm::Type::Greedy, false, 0, false },
+		{ U"beam", Algorithm::Type::BeamSearch, false, 64 * 128, false },
+		{ U"greedy2", Algorithm::Type::ImprovedGreedy, true, 0, true },
+		{ U"portfolio", Algorithm::Type::Portfolio, true, 0, true },
+		{ U"twophase", Algorithm::Type::TwoPhase, false, 0, false },
+	} };
+
+	struct BenchCase {
+		String name;
+		int32 width;
+		int32 height;
+		ProblemGenerator::Distribution distribution;
+		uint64 seed;
+	};
+
+	// 問題集：正方形と長方形の盤面サイズ × 初期盤面の作り方
+	// 種は固定なので、同じ版のソルバなら何度走らせても同じ問題になる
+	// 作り方は末尾に足す（前からある問題の種を変えないため）
+	Array<BenchCase> makeCorpus(bool quick) {
+		constexpr std::array<std::pair<int32, int32>, 7> sizes = { {
+			{ 32, 32 }, { 64, 64 }, { 128, 128 }, { 256, 256 }, { 32, 256 }, { 256, 64 }, { 200, 120 },
+		} };
+		constexpr std::array<ProblemGenerator::Distribution, 5> distributions = {
+			ProblemGenerator::Distribution::Shuffle, ProblemGenerator::Distribution::RowPermuted,
+			ProblemGenerator::Distribution::ColumnPermuted, ProblemGenerator::Distribution::BlockShuffled,
+			ProblemGenerator::Distribution::PartiallySolved,
+		};
+
+		// --quick でも同じ名前の問題は同じ種になるように、飛ばす問題にも種を割り当てる
+		Array<BenchCase> corpus;
+		uint64 seed = 20240000ULL;
+		for (const auto distribution : distributions) {
+			for (const auto& [width, height] : sizes) {
+				const uint64 caseSeed = seed++;
+				if (quick && Max(width, height) > 64) continue;
+				const String name = U"{}-{}x{}"_fmt(ProblemGenerator::distributionName(distribution), width, height);
+				corpus << BenchCase{ name, width, height, distribution, caseSeed };
+			}
+		}
+		return corpus;
+	}
+
+	// 最大常駐メモリ（KiB）。Linux では計測ごとに /proc/self/clear_refs でリセットする。取れなければ -1
+	void resetPeakMemory() {
+#ifdef __linux__
+		std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+	}
+
+	int64 peakMemoryKiB() {
+#ifdef __linux__
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line)) {
+			if (line.starts_with("VmHWM:")) return std::strtoll(line.c_str() + 6, nullptr, 10);
+		}
+#endif
+		return -1;
+	}
+
+	struct CommandLine {
+		std::string outputPath = "bench_report.json";
+		std::string baselinePath;
+		Array<AlgorithmEntry> algorithms;
+		String caseFilter;
+		double timeLimit = 10.0;
+		int32 threads = 0;
+		bool quick = false;
+		double tolerance = 0.0;
+		double timeTolerance = 10.0;
+		bool verbose = false;
+	};
+
+	void printUsage(std::FILE* out) {
+		std::fputs(
+			"usage: procon_bench [options]\n"
+			"  -o, --output <path>        report path (default: bench_report.json)\n"
+			"  -b, --baseline <path>      previous report to compare against\n"
+			"  -a, --algorithms <list>    comma-separated: greedy,beam,greedy2,portfolio,twophase (default: all)\n"
+			"  -c, --cases <text>         only cases whose name contains text\n"
+			"  -t, --time <seconds>       time limit for greedy2 / portfolio (default: 10)\n"
+			"  -j, --threads <n>          worker threads (0: hardware concurrency)\n"
+			"      --quick                sides up to 64 only, 2 second time limit\n"
+			"      --tolerance <pct>      allowed step increase over the baseline (default: 0)\n"
+			"      --time-tolerance <pct> time increase reported as slower (default: 10)\n"
+			"  -v, --verbose              print solver progress to stderr\n"
+			"  -h, --help                 show this help\n", out);
+	}
+
+	bool parseCommandLine(int argc, char** argv, CommandLine& commandLine) {
+		bool timeGiven = false;
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg = argv[i];
+			auto value = [&]() -> const char* {
+				if (i + 1 >= argc) {
+					std::fprintf(stderr, "error: %s needs a value\n", argv[i]);
+					return nullptr;
+				}
+				return argv[++i];
+			};
+			auto number = [&](double& target) {
+				const char* text = value();
+				if (!text) return false;
+				char* end = nullptr;
+				target = std::strtod(text, &end);
+				if (end == text || *end != '\0' || target < 0) {
+					std::fprintf(stderr, "error: invalid value for %s: %s\n", argv[i - 1], text);
+					return false;
+				}
+				return true;
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				printUsage(stdout);
+				std::exit(0);
+			}
+			else if (arg == "-o" || arg == "--output") {
+				const char* path = value();
+				if (!path) return false;
+				commandLine.outputPath = path;
+			}
+			else if (arg == "-b" || arg == "--baseline") {
+				const char* path = value();
+				if (!path) return false;
+				commandLine.baselinePath = path;
+			}
+			else if (arg == "-a" || arg == "--algorithms") {
+				const char* list = value();
+				if (!list) return false;
+				const String names = Unicode::FromUTF8(list);
+				for (size_t begin = 0; begin <= names.size();) {
+					const size_t end = Min(names.find(U',', begin), names.size());
+					const String name = names.substr(begin, end - begin);
+					const auto found = std::find_if(Algorithms.begin(), Algorithms.end(), [&](const AlgorithmEntry& entry) { return name == entry.name; });
+					if (found == Algorithms.end()) {
+						std::fprintf(stderr, "error: unknown algorithm: %s\n", Unicode::ToUTF8(name).c_str());
+						return false;
+					}
+					commandLine.algorithms << *found;
+					begin = end + 1;
+				}
+			}
+			else if (arg == "-c" || arg == "--cases") {
+				const char* text = value();
+				if (!text) return false;
+				commandLine.caseFilter = Unicode::FromUTF8(text);
+			}
+			else if (arg == "-t" || arg == "--time") {
+				if (!number(commandLine.timeLimit)) return false;
+				timeGiven = true;
+			}
+			else if (arg == "-j" || arg == "--threads") {
+				double threads = 0;
+				if (!number(threads)) return false;
+				commandLine.threads = static_cast<int32>(threads);
+			}
+			else if (arg == "--quick") {
+				commandLine.quick = true;
+			}
+			else if (arg == "--tolerance") {
+				if (!number(commandLine.tolerance)) return false;
+			}
+			else if (arg == "--time-tolerance") {
+				if (!number(commandLine.timeTolerance)) return false;
+			}
+			else if (arg == "-v" || arg == "--verbose") {
+				commandLine.verbose = true;
+			}
+			else {
+				std::fprintf(stderr, "error: unknown argument: %s\n", argv[i]);
+				return false;
+			}
+		}
+		if (commandLine.algorithms.isEmpty()) {
+			commandLine.algorithms = Array<AlgorithmEntry>(Algorithms.begin(), Algorithms.end());
+		}
+		if (commandLine.quick && !timeGiven) {
+			commandLine.timeLimit = 2.0;
+		}
+		return true;
+	}
+
+	struct RunResult {
+		size_t steps = 0;
+		bool valid = false;
+		double seconds = 0.0;
+		// 試行回数を数えないアルゴリズムでは使わない
+		double trialsPerSecond = 0.0;
+		int64 peakMemoryKiB = -1;
+		size_t peakStateBytes = 0;
+	};
+
+	RunResult run(const AlgorithmEntry& algorithm, const Board& board, const Array<Pattern>& patterns, const CommandLine& commandLine) {
+		Algorithm::SolverStats stats;
+		Algorithm::Options options;
+		options.timeLimit = algorithm.anytime ? commandLine.timeLimit : 0.0;
+		options.threads = commandLine.threads;
+		// 乱数も固定する（時間で打ち切るアルゴリズムは、それでも計算機の速さで結果が変わる）
+		options.seed = 1;
+		options.stats = &stats;
+
+		RunResult result;
+		resetPeakMemory();
+		const auto start = std::chrono::steady_clock::now();
+		try {
+			const Algorithm::Solution solution = Algorithm::solve(algorithm.type, board, patterns, options);
+			result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			result.steps = solution.steps.size();
+			result.valid = Algorithm::isValidSolution(board, solution);
+		}
+		catch (const Error& error) {
+			result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::fprintf(stderr, "error: %s\n", Unicode::ToUTF8(error.what()).c_str());
+		}
+		result.peakMemoryKiB = peakMemoryKiB();
+		result.trialsPerSecond = result.seconds > 0 ? stats.trials.load() / result.seconds : 0.0;
+		result.peakStateBytes = stats.peakStateBytes.load();
+		return result;
+	}
+
+	double changePercent(double before, double after) {
+		return before > 0 ? 100.0 * (after - before) / before : 0.0;
+	}
+
+	// 前回のレポートと比べて表示する。手数が増えた・解けなくなった組があれば false
+	bool compareWithBaseline(const JSON& report, const JSON& baseline, const CommandLine& commandLine) {
+		size_t compared = 0, regressions = 0, improvements = 0, slower = 0, faster = 0;
+		double stepsBefore = 0, stepsAfter = 0, secondsBefore = 0, secondsAfter = 0;
+
+		std::printf("\n%-24s %-10s %17s %8s %19s %8s\n", "case", "algorithm", "steps", "change", "seconds", "change");
+		for (const auto& result : report[U"results"].arrayView()) {
+			const JSON* previous = nullptr;
+			for (const auto& candidate : baseline[U"results"].arrayView()) {
+				if (candidate[U"case"].getString() == result[U"case"].getString()
+					&& candidate[U"algorithm"].getString() == result[U"algorithm"].getString()) {
+					previous = &candidate;
+					break;
+				}
+			}
+			if (!previous) continue;
+			++compared;
+
+			const double beforeSteps = (*previous)[U"steps"].get<double>(), afterSteps = result[U"steps"].get<double>();
+			const double beforeSeconds = (*previous)[U"seconds"].get<double>(), afterSeconds = result[U"seconds"].get<double>();
+			const bool wasValid = (*previous)[U"valid"].get<bool>(), isValid = result[U"valid"].get<bool>();
+			const double stepChange = changePercent(beforeSteps, afterSteps);
+			const double timeChange = changePercent(beforeSeconds, afterSeconds);
+
+			const char* mark = "";
+			if ((wasValid && !isValid) || (isValid && wasValid && stepChange > commandLine.tolerance)) {
+				mark = "  REGRESSION";
+				++regressions;
+			}
+			else if (isValid && (!wasValid || afterSteps < beforeSteps)) {
+				mark = "  better";
+				++improvements;
+			}
+			// 短すぎる計測は揺れが大きいので比べない
+			const bool timed = Max(beforeSeconds, afterSeconds) >= 0.05;
+			if (timed && timeChange > commandLine.timeTolerance) ++slower;
+			if (timed && timeChange < -commandLine.timeTolerance) ++faster;
+
+			if (isValid && wasValid) {
+				stepsBefore += beforeSteps;
+				stepsAfter += afterSteps;
+				secondsBefore += beforeSeconds;
+				secondsAfter += afterSeconds;
+			}
+
+			std::printf("%-24s %-10s %8.0f -> %6.0f %+7.2f%% %8.3f -> %8.3f %+7.1f%%%s%s\n",
+				Unicode::ToUTF8(result[U"case"].getString()).c_str(), Unicode::ToUTF8(result[U"algorithm"].getString()).c_str(),
+				beforeSteps, afterSteps, stepChange, beforeSeconds, afterSeconds, timeChange,
+				(timed && timeChange > commandLine.timeTolerance) ? "  slower" : "", mark);
+		}
+
+		std::printf("\ncompared %zu runs: %zu regressions, %zu fewer steps, %zu slower, %zu faster\n", compared, regressions, improvements, slower, faster);
+		std::printf("total steps %.0f -> %.0f (%+.2f%%), total seconds %.3f -> %.3f (%+.1f%%)\n",
+			stepsBefore, stepsAfter, changePercent(stepsBefore, stepsAfter), secondsBefore, secondsAfter, changePercent(secondsBefore, secondsAfter));
+		return regressions == 0;
+	}
+}
+
+int main(int argc, char** argv) {
+	CommandLine commandLine;
+	if (!parseCommandLine(argc, argv, commandLine)) {
+		printUsage(stderr);
+		return 2;
+	}
+	Console.setEnabled(commandLine.verbose);
+
+	const Array<Pattern> patterns = StandardPatterns::getAllStandardPatterns_Grid();
+	const Array<BenchCase> corpus = makeCorpus(commandLine.quick);
+	const int32 threads = commandLine.threads > 0 ? commandLine.threads : static_cast<int32>(Max(1u, std::thread::hardware_concurrency()));
+
+	Array<JSON> results;
+	bool allValid = true;
+	std::printf("%-24s %-10s %8s %6s %9s %12s %10s\n", "case", "algorithm", "steps", "valid", "seconds", "trials/s", "peak KiB");
+	for (const auto& benchCase : corpus) {
+		if (!commandLine.caseFilter.empty() && benchCase.name.find(commandLine.caseFilter) == String::npos) continue;
+		const Board board = ProblemGenerator::generateBoard(benchCase.width, benchCase.height, benchCase.distribution, benchCase.seed);
+
+		for (const auto& algorithm : commandLine.algorithms) {
+			if (algorithm.maxCells > 0 && benchCase.width * benchCase.height > algorithm.maxCells) continue;
+			const RunResult result = run(algorithm, board, patterns, commandLine);
+			allValid = allValid && result.valid;
+			char trialsPerSecond[32] = "-";
+			if (algorithm.countsTrials) std::snprintf(trialsPerSecond, sizeof(trialsPerSecond), "%.1f", result.trialsPerSecond);
+			std::printf("%-24s %-10s %8zu %6s %9.3f %12s %10lld\n",
+				Unicode::ToUTF8(benchCase.name).c_str(), Unicode::ToUTF8(algorithm.name).c_str(),
+				result.steps, result.valid ? "yes" : "NO", result.seconds, trialsPerSecond, static_cast<long long>(result.peakMemoryKiB));
+			std::fflush(stdout);
+
+			JSON entry;
+			entry[U"case"] = benchCase.name;
+			entry[U"distribution"] = ProblemGenerator::distributionName(benchCase.distribution);
+			entry[U"width"] = benchCase.width;
+			entry[U"height"] = benchCase.height;
+			entry[U"seed"] = benchCase.seed;
+			entry[U"algorithm"] = algorithm.name;
+			entry[U"steps"] = static_cast<int64>(result.steps);
+			entry[U"valid"] = result.valid;
+			entry[U"seconds"] = result.seconds;
+			// 試行回数を数えないアルゴリズムでは書かない
+			if (algorithm.countsTrials) entry[U"trialsPerSecond"] = result.trialsPerSecond;
+			entry[U"peakMemoryKiB"] = result.peakMemoryKiB;
+			entry[U"peakStateKiB"] = static_cast<int64>(result.peakStateBytes / 1024);
+			results << entry;
+		}
+	}
+
+	JSON report;
+	report[U"schema"] = 1;
+	report[U"quick"] = commandLine.quick;
+	report[U"timeLimit"] = commandLine.timeLimit;
+	report[U"threads"] = threads;
+	report[U"results"] = results;
+	if (!report.save(Unicode::FromUTF8(commandLine.outputPath))) {
+		std::fprintf(stderr, "error: cannot write %s\n", commandLine.outputPath.c_str());
+		return 1;
+	}
+	std::printf("\nreport: %s\n", commandLine.outputPath.c_str());
+
+	bool noRegression = true;
+	if (!commandLine.baselinePath.empty()) {
+		const JSON baseline = JSON::Load(Unicode::FromUTF8(commandLine.baselinePath));
+		if (not baseline) {
+			std::fprintf(stderr, "error: cannot read baseline %s\n", commandLine.baselinePath.c_str());
+			return 1;
+		}
+		noRegression = compareWithBaseline(report, baseline, commandLine);
+	}
+	return allValid && noRegression ? 0 : 1;
+}
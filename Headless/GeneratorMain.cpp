@@ -0,0 +1,153 @@
+﻿// GeneratorMain.cpp
+// 乱数の種から問題の JSON を作る（サーバーなしで大きな盤面を試すため）
+//
+// 使い方: procon_generate [オプション]
+//   -W, --width <n>          盤面の幅（32〜256、省略すると種から決める）
+//   -H, --height <n>         盤面の高さ（32〜256、省略すると種から決める）
+//   -d, --distribution <名前> shuffle / rows / columns / blocks / partial（既定 shuffle）
+//   --seed <n>               乱数の種（既定 1）
+//   -g, --general <n>        一般抜き型の数（0〜256、既定 8）
+//   --pattern-size <n>       一般抜き型の一辺の最大（1〜256、既定 32）
+//   --block-size <n>         blocks のブロックの一辺（既定 8）
+//   --solved <割合>          partial で揃っている行の割合（既定 0.5）
+//   -o, --output <パス>      出力先（既定 problem.json）
+//
+// 出力は可視化ツール（initializeFromJSON）と procon_solver がそのまま読める形式
+
+#include "Core.h"
+#include "ProblemGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+
+namespace {
+
+	struct CommandLine {
+		ProblemGenerator::Settings settings;
+		bool widthGiven = false;
+		bool heightGiven = false;
+		std::string outputPath = "problem.json";
+	};
+
+	void printUsage(std::FILE* out) {
+		std::fputs(
+			"usage: procon_generate [options]\n"
+			"  -W, --width <n>            board width, 32-256 (default: chosen from the seed)\n"
+			"  -H, --height <n>           board height, 32-256 (default: chosen from the seed)\n"
+			"  -d, --distribution <name>  shuffle | rows | columns | blocks | partial (default: shuffle)\n"
+			"      --seed <n>             random seed (default: 1)\n"
+			"  -g, --general <n>          number of general patterns, 0-256 (default: 8)\n"
+			"      --pattern-size <n>     maximum side of a general pattern, 1-256 (default: 32)\n"
+			"      --block-size <n>       block side for 'blocks' (default: 8)\n"
+			"      --solved <ratio>       solved row ratio for 'partial' (default: 0.5)\n"
+			"  -o, --output <path>        problem JSON path (default: problem.json)\n"
+			"  -h, --help                 show this help\n", out);
+	}
+
+	bool parseCommandLine(int argc, char** argv, CommandLine& commandLine) {
+		auto& settings = commandLine.settings;
+		settings.generalCount = 8;
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg = argv[i];
+			auto value = [&]() -> const char* {
+				if (i + 1 >= argc) {
+					std::fprintf(stderr, "error: %s needs a value\n", argv[i]);
+					return nullptr;
+				}
+				return argv[++i];
+			};
+			auto number = [&](auto& target) {
+				const char* text = value();
+				if (!text) return false;
+				char* end = nullptr;
+				const double parsed = std::strtod(text, &end);
+				if (end == text || *end != '\0' || parsed < 0) {
+					std::fprintf(stderr, "error: invalid value for %s: %s\n", argv[i - 1], text);
+					return false;
+				}
+				target = static_cast<std::remove_reference_t<decltype(target)>>(parsed);
+				return true;
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				printUsage(stdout);
+				std::exit(0);
+			}
+			else if (arg == "-W" || arg == "--width") {
+				if (!number(settings.width)) return false;
+				commandLine.widthGiven = true;
+			}
+			else if (arg == "-H" || arg == "--height") {
+				if (!number(settings.height)) return false;
+				commandLine.heightGiven = true;
+			}
+			else if (arg == "-d" || arg == "--distribution") {
+				const char* name = value();
+				if (!name) return false;
+				if (!ProblemGenerator::parseDistribution(Unicode::FromUTF8(name), settings.distribution)) {
+					std::fprintf(stderr, "error: unknown distribution: %s\n", name);
+					return false;
+				}
+			}
+			else if (arg == "--seed") {
+				const char* text = value();
+				if (!text) return false;
+				settings.seed = std::strtoull(text, nullptr, 10);
+			}
+			else if (arg == "-g" || arg == "--general") {
+				if (!number(settings.generalCount)) return false;
+			}
+			else if (arg == "--pattern-size") {
+				if (!number(settings.maxPatternSize)) return false;
+			}
+			else if (arg == "--block-size") {
+				if (!number(settings.blockSize)) return false;
+			}
+			else if (arg == "--solved") {
+				if (!number(settings.solvedRatio)) return false;
+			}
+			else if (arg == "-o" || arg == "--output") {
+				const char* path = value();
+				if (!path) return false;
+				commandLine.outputPath = path;
+			}
+			else {
+				std::fprintf(stderr, "error: unknown argument: %s\n", argv[i]);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv) {
+	CommandLine commandLine;
+	if (!parseCommandLine(argc, argv, commandLine)) {
+		printUsage(stderr);
+		return 2;
+	}
+	Console.setEnabled(false);
+
+	// 大きさを指定しなければ、公式の範囲から種で選ぶ
+	auto& settings = commandLine.settings;
+	ProblemGenerator::Random random(settings.seed);
+	const auto sides = ProblemGenerator::MaxBoardSize - ProblemGenerator::MinBoardSize + 1;
+	if (!commandLine.widthGiven) settings.width = ProblemGenerator::MinBoardSize + static_cast<int32>(random.below(sides));
+	if (!commandLine.heightGiven) settings.height = ProblemGenerator::MinBoardSize + static_cast<int32>(random.below(sides));
+
+	try {
+		const ProblemGenerator::Problem problem = ProblemGenerator::generate(settings);
+		if (!problem.toJSON().save(Unicode::FromUTF8(commandLine.outputPath))) {
+			std::fprintf(stderr, "error: cannot write %s\n", commandLine.outputPath.c_str());
+			return 1;
+		}
+		std::printf("%s: %dx%d %s, %d general patterns (seed %llu)\n", commandLine.outputPath.c_str(), settings.width, settings.height,
+			Unicode::ToUTF8(ProblemGenerator::distributionName(settings.distribution)).c_str(),
+			settings.generalCount, static_cast<unsigned long long>(settings.seed));
+		return 0;
+	}
+	catch (const Error& error) {
+		std::fprintf(stderr, "error: %s\n", Unicode::ToUTF8(error.what()).c_str());
+		return 1;
+	}
+}
@@ -0,0 +1,409 @@
+﻿// KernelBenchmark.cpp
+// 盤面操作（抜き型の適用・揃っているマスの数え上げ・候補探し）だけを測るマイクロベンチマーク
+// Board（可視化用）と OptimizedBoard（探索用）の両方を、定型抜き型 25 種 × 4 方向 × 代表的な位置 × 盤面サイズで測る
+//
+// 使い方: procon_kernel_bench [オプション]
+//   -s, --sizes <list>     盤面サイズ（カンマ区切り、"64" または "256x32"。既定 32,64,128,256）
+//   -k, --kernels <text>   名前にこの文字列を含むカーネルだけ測る
+//   --min-time <ms>        1項目を測る最短の時間（既定 5）
+//   --detail               抜き型・位置ごとの結果も出す
+//   -o, --output <path>    抜き型・位置ごとの結果を JSON にも書く
+//
+// ns/op は1回の呼び出しにかかった時間、cells/ns は1ナノ秒あたりに扱ったマス数
+// 扱うマス数は、抜き型の適用では動きうる範囲（上なら抜き型の列 × 一番上の抜く行から下）、それ以外は盤面全体のマス数
+// 盤面は上半分が揃った状態で測る（数え上げと候補探しが、探索の途中と同じだけ盤面を読むように）
+
+#include "Core.h"
+#include "Pattern.h"
+#include "StandardPatterns.h"
+#include "Board.h"
+#include "OptimizedBoard.h"
+#include "ProblemGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+
+namespace {
+
+	using Algorithm::OptimizedBoard;
+
+	// 結果を捨てられないように足し込む先
+	volatile int64 Sink = 0;
+
+	struct Measurement {
+		double nanoseconds = 0;
+		int64 ops = 0;
+	};
+
+	// minSeconds を超えるまで、回数を倍にしながら body を繰り返す
+	template <class Body>
+	Measurement measure(double minSeconds, Body&& body) {
+		Sink = Sink + body();
+		Measurement result;
+		for (int64 batch = 1;; batch *= 2) {
+			int64 sum = 0;
+			const auto start = std::chrono::steady_clock::now();
+			for (int64 i = 0; i < batch; ++i) {
+				sum += body();
+			}
+			result.nanoseconds += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			result.ops += batch;
+			Sink = Sink + sum;
+			if (result.nanoseconds >= minSeconds * 1e9) return result;
+		}
+	}
+
+	struct CommandLine {
+		Array<Point> sizes = { Point(32, 32), Point(64, 64), Point(128, 128), Point(256, 256) };
+		String kernelFilter;
+		double minSeconds = 0.005;
+		bool detail = false;
+		std::string outputPath;
+	};
+
+	void printUsage(std::FILE* out) {
+		std::fputs(
+			"usage: procon_kernel_bench [options]\n"
+			"  -s, --sizes <list>     board sizes, e.g. 32,64,256x32 (default: 32,64,128,256)\n"
+			"  -k, --kernels <text>   only kernels whose name contains text\n"
+			"      --min-time <ms>    minimum measuring time per item (default: 5)\n"
+			"      --detail           also print per pattern / position results\n"
+			"  -o, --output <path>    write per pattern / position results as JSON\n"
+			"  -h, --help             show this help\n", out);
+	}
+
+	bool parseSize(std::string_view text, Point& size) {
+		char* end = nullptr;
+		const std::string copy(text);
+		const long width = std::strtol(copy.c_str(), &end, 10);
+		long height = width;
+		if (*end == 'x') {
+			const char* begin = end + 1;
+			height = std::strtol(begin, &end, 10);
+			if (end == begin) return false;
+		}
+		if (*end != '\0' || width < 1 || height < 1 || width > 256 || height > 256) return false;
+		size = Point(static_cast<int32>(width), static_cast<int32>(height));
+		return true;
+	}
+
+	bool parseCommandLine(int argc, char** argv, CommandLine& commandLine) {
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg = argv[i];
+			auto value = [&]() -> const char* {
+				if (i + 1 >= argc) {
+					std::fprintf(stderr, "error: %s needs a value\n", argv[i]);
+					return nullptr;
+				}
+				return argv[++i];
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				printUsage(stdout);
+				std::exit(0);
+			}
+			else if (arg == "-s" || arg == "--sizes") {
+				const char* list = value();
+				if (!list) return false;
+				commandLine.sizes.clear();
+				const std::string_view sizes = list;
+				for (size_t begin = 0; begin <= sizes.size();) {
+					const size_t end = Min(sizes.find(',', begin), sizes.size());
+					Point size;
+					if (!parseSize(sizes.substr(begin, end - begin), size)) {
+						std::fprintf(stderr, "error: invalid board size in %s\n", list);
+						return false;
+					}
+					commandLine.sizes << size;
+					begin = end + 1;
+				}
+			}
+			else if (arg == "-k" || arg == "--kernels") {
+				const char* text = value();
+				if (!text) return false;
+				commandLine.kernelFilter = Unicode::FromUTF8(text);
+			}
+			else if (arg == "--min-time") {
+				const char* text = value();
+				if (!text) return false;
+				char* end = nullptr;
+				const double milliseconds = std::strtod(text, &end);
+				if (end == text || *end != '\0' || milliseconds <= 0) {
+					std::fprintf(stderr, "error: invalid value for --min-time: %s\n", text);
+					return false;
+				}
+				commandLine.minSeconds = milliseconds / 1000;
+			}
+			else if (arg == "--detail") {
+				commandLine.detail = true;
+			}
+			else if (arg == "-o" || arg == "--output") {
+				const char* path = value();
+				if (!path) return false;
+				commandLine.outputPath = path;
+			}
+			else {
+				std::fprintf(stderr, "error: unknown argument: %s\n", argv[i]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	constexpr std::array<const char32_t*, 4> DirectionNames = { U"up", U"down", U"left", U"right" };
+
+	// 抜き型を置く代表的な位置：左上、中央、右下にはみ出す位置
+	std::array<std::pair<const char32_t*, Point>, 3> placements(const Pattern& pattern, int32 width, int32 height) {
+		const int32 w = static_cast<int32>(pattern.grid.width()), h = static_cast<int32>(pattern.grid.height());
+		return { {
+			{ U"origin", Point(0, 0) },
+			{ U"center", Point((width - w) / 2, (height - h) / 2) },
+			{ U"overhang", Point(width - (w + 1) / 2, height - (h + 1) / 2) },
+		} };
+	}
+
+	// 抜き型の適用で動きうるマス数
+	int64 movedCells(const Pattern& pattern, Point pos, int32 direction, int32 width, int32 height) {
+		int32 left = width, right = -1, top = height, bottom = -1;
+		for (int32 y = 0; y < static_cast<int32>(pattern.grid.height()); ++y) {
+			for (int32 x = 0; x < static_cast<int32>(pattern.grid.width()); ++x) {
+				const int32 bx = pos.x + x, by = pos.y + y;
+				if (pattern.grid[y][x] == 1 && 0 <= bx && bx < width && 0 <= by && by < height) {
+					left = Min(left, bx);
+					right = Max(right, bx);
+					top = Min(top, by);
+					bottom = Max(bottom, by);
+				}
+			}
+		}
+		if (right < 0) return 0;
+		switch (direction) {
+		case 0: return int64(right - left + 1) * (height - top);
+		case 1: return int64(right - left + 1) * (bottom + 1);
+		case 2: return int64(bottom - top + 1) * (width - left);
+		default: return int64(bottom - top + 1) * (right + 1);
+		}
+	}
+
+	// カーネルごとの合計
+	struct Total {
+		String board;
+		Point size;
+		String kernel;
+		// 項目ごとの ns/op の和と項目数
+		double nanoseconds = 0;
+		int64 items = 0;
+		double cells = 0;
+	};
+
+	class Runner {
+	public:
+		explicit Runner(const CommandLine& commandLine)
+			: m_commandLine(commandLine) {}
+
+		bool wants(StringView kernel) const {
+			return m_commandLine.kernelFilter.empty() || String(kernel).find(m_commandLine.kernelFilter) != String::npos;
+		}
+
+		// 1項目を測って合計に足す。cells は1回あたりのマス数
+		template <class Body>
+		void run(StringView board, Point size, StringView kernel, StringView item, int64 cells, Body&& body) {
+			const Measurement measurement = measure(m_commandLine.minSeconds, body);
+			const double nsPerOp = measurement.nanoseconds / measurement.ops;
+			if (m_commandLine.detail && !item.empty()) {
+				print(board, size, String(kernel) + U" " + String(item), nsPerOp, cells / nsPerOp);
+			}
+			if (!m_commandLine.outputPath.empty()) {
+				JSON entry;
+				entry[U"board"] = board;
+				entry[U"width"] = size.x;
+				entry[U"height"] = size.y;
+				entry[U"kernel"] = kernel;
+				entry[U"item"] = item;
+				entry[U"nsPerOp"] = nsPerOp;
+				entry[U"cellsPerNs"] = cells / nsPerOp;
+				m_entries << entry;
+			}
+
+			if (m_totals.isEmpty() || m_totals.back().board != board || m_totals.back().size != size || m_totals.back().kernel != kernel) {
+				m_totals << Total{ String(board), size, String(kernel) };
+			}
+			// 項目ごとの ns/op の平均になるように、1回分ずつ足す
+			Total& total = m_totals.back();
+			total.nanoseconds += nsPerOp;
+			++total.items;
+			total.cells += static_cast<double>(cells);
+		}
+
+		// 項目をまとめた結果を出す
+		void printTotals() {
+			for (const auto& total : m_totals) {
+				const double nsPerOp = total.nanoseconds / total.items;
+				print(total.board, total.size, total.kernel, nsPerOp, total.cells / total.nanoseconds);
+			}
+			m_totals.clear();
+		}
+
+		bool save() const {
+			if (m_commandLine.outputPath.empty()) return true;
+			JSON report;
+			report[U"minTimeMs"] = m_commandLine.minSeconds * 1000;
+			report[U"results"] = m_entries;
+			return report.save(Unicode::FromUTF8(m_commandLine.outputPath));
+		}
+
+		static void printHeader() {
+			std::printf("%-10s %-8s %-48s %12s %10s\n", "board", "size", "kernel", "ns/op", "cells/ns");
+		}
+
+	private:
+		static void print(StringView board, Point size, StringView kernel, double nsPerOp, double cellsPerNs) {
+			const std::string sizeText = std::to_string(size.x) + "x" + std::to_string(size.y);
+			std::printf("%-10s %-8s %-48s %12.1f %10.3f\n", Unicode::ToUTF8(String(board)).c_str(), sizeText.c_str(),
+				Unicode::ToUTF8(String(kernel)).c_str(), nsPerOp, cellsPerNs);
+			std::fflush(stdout);
+		}
+
+		const CommandLine& m_commandLine;
+		Array<Total> m_totals;
+		Array<JSON> m_entries;
+	};
+
+	// 定型抜き型 × 4 方向 × 位置で apply_pattern を測る（方向ごとにまとめる）
+	template <class BoardType>
+	void benchmarkApply(Runner& runner, StringView boardName, BoardType& board, const Array<Pattern>& patterns, Point size) {
+		for (int32 direction = 0; direction < 4; ++direction) {
+			const String kernel = U"apply_pattern/" + String(DirectionNames[direction]);
+			if (!runner.wants(kernel)) continue;
+			for (const auto& pattern : patterns) {
+				for (const auto& [positionName, pos] : placements(pattern, size.x, size.y)) {
+					const String item = U"p{} {}x{} {}"_fmt(pattern.p, pattern.grid.width(), pattern.grid.height(), positionName);
+					runner.run(boardName, size, kernel, item, movedCells(pattern, pos, direction, size.x, size.y), [&, pos = pos]() -> int64 {
+						board.apply_pattern(pattern, pos, direction);
+						return 1;
+					});
+				}
+			}
+		}
+	}
+
+	void benchmarkOptimizedBoard(Runner& runner, const Board& source, const Array<Pattern>& patterns) {
+		const Point size(source.width, source.height);
+		const int64 cells = int64(size.x) * size.y;
+		const StringView name = U"optimized";
+
+		{
+			OptimizedBoard board(source.width, source.height, source.grid, source.goal);
+			benchmarkApply(runner, name, board, patterns, size);
+		}
+
+		OptimizedBoard board(source.width, source.height, source.grid, source.goal);
+		// 揃っている所の覚えを消して、毎回最初から数えさせる
+		auto forget = [&]() {
+			board.set(0, 0, board.getGrid(0, 0));
+		};
+		if (runner.wants(U"getCorrectCount")) {
+			runner.run(name, size, U"getCorrectCount", U"", cells, [&]() -> int64 {
+				forget();
+				return board.getCorrectCount();
+			});
+		}
+		if (runner.wants(U"getCorrectCountAll")) {
+			runner.run(name, size, U"getCorrectCountAll", U"", cells, [&]() -> int64 {
+				forget();
+				return board.getCorrectCountAll();
+			});
+		}
+
+		// 候補探しは、探索と同じく最初の揃っていないマスについて行う
+		const int32 first = board.getCorrectCount();
+		if (first >= size.x * size.y) return;
+		const int32 a = first % size.x, b = first / size.x;
+		Algorithm::SearchBuffer buffer;
+		if (runner.wants(U"findClosestPointWithSameValue")) {
+			runner.run(name, size, U"findClosestPointWithSameValue", U"", cells, [&]() -> int64 {
+				return board.findClosestPointWithSameValue(a, b).x;
+			});
+		}
+		if (runner.wants(U"findPointsWithSameValue")) {
+			runner.run(name, size, U"findPointsWithSameValue", U"", cells, [&]() -> int64 {
+				return static_cast<int64>(board.findPointsWithSameValue(a, b, buffer).size());
+			});
+		}
+		if (runner.wants(U"findPointsWithSameValueAndYPopcountDiff1")) {
+			runner.run(name, size, U"findPointsWithSameValueAndYPopcountDiff1", U"", cells, [&]() -> int64 {
+				return static_cast<int64>(board.findPointsWithSameValueAndYPopcountDiff1(a, b, buffer).size());
+			});
+		}
+		if (runner.wants(U"sortedFindPointsWithSameValueAndYPopcountDiff1")) {
+			runner.run(name, size, U"sortedFindPointsWithSameValueAndYPopcountDiff1", U"", cells, [&]() -> int64 {
+				return static_cast<int64>(board.sortedFindPointsWithSameValueAndYPopcountDiff1(a, b, buffer).size());
+			});
+		}
+		if (runner.wants(U"findPointsWithSameValueInSameRow")) {
+			runner.run(name, size, U"findPointsWithSameValueInSameRow", U"", cells, [&]() -> int64 {
+				return static_cast<int64>(board.findPointsWithSameValueInSameRow(a, b, buffer).size());
+			});
+		}
+	}
+
+	void benchmarkBoard(Runner& runner, const Board& source, const Array<Pattern>& patterns) {
+		const Point size(source.width, source.height);
+		const int64 cells = int64(size.x) * size.y;
+		const StringView name = U"board";
+
+		{
+			Board board = source;
+			benchmarkApply(runner, name, board, patterns, size);
+		}
+
+		// Board には揃っている所の覚えがないので、そのまま数える
+		if (runner.wants(U"calculateDifference")) {
+			runner.run(name, size, U"calculateDifference", U"", cells, [&]() -> int64 {
+				return source.calculateDifference(source.goal);
+			});
+		}
+		if (runner.wants(U"is_goal")) {
+			runner.run(name, size, U"is_goal", U"", cells, [&]() -> int64 {
+				return source.is_goal();
+			});
+		}
+	}
+
+	// 上半分が揃った盤面
+	Board halfSolvedBoard(Point size) {
+		Board board = ProblemGenerator::generateBoard(size.x, size.y, ProblemGenerator::Distribution::Shuffle, 20240000ULL + size.x * 257 + size.y);
+		for (int32 y = 0; y < size.y / 2; ++y) {
+			for (int32 x = 0; x < size.x; ++x) {
+				board.grid[y][x] = board.goal[y][x];
+			}
+		}
+		return board;
+	}
+}
+
+int main(int argc, char** argv) {
+	CommandLine commandLine;
+	if (!parseCommandLine(argc, argv, commandLine)) {
+		printUsage(stderr);
+		return 2;
+	}
+	Console.setEnabled(false);
+
+	const Array<Pattern> patterns = StandardPatterns::getAllStandardPatterns_Grid();
+	Runner runner(commandLine);
+	Runner::printHeader();
+	for (const auto& size : commandLine.sizes) {
+		const Board board = halfSolvedBoard(size);
+		benchmarkOptimizedBoard(runner, board, patterns);
+		runner.printTotals();
+		benchmarkBoard(runner, board, patterns);
+		runner.printTotals();
+	}
+
+	if (!runner.save()) {
+		std::fprintf(stderr, "error: cannot write %s\n", commandLine.outputPath.c_str());
+		return 1;
+	}
+	return 0;
+}
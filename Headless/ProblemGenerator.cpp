@@ -0,0 +1,209 @@
+﻿// ProblemGenerator.cpp
+
+#include "ProblemGenerator.h"
+
+namespace ProblemGenerator {
+
+	namespace {
+		constexpr std::array<std::pair<Distribution, const char32_t*>, 5> DistributionNames = { {
+			{ Distribution::Shuffle, U"shuffle" },
+			{ Distribution::RowPermuted, U"rows" },
+			{ Distribution::ColumnPermuted, U"columns" },
+			{ Distribution::BlockShuffled, U"blocks" },
+			{ Distribution::PartiallySolved, U"partial" },
+		} };
+
+		// 一般抜き型の乱数は盤面と別の列にする
+		constexpr uint64 PatternSeedOffset = 0x6a09e667f3bcc909ULL;
+
+		// 各値がマス数の1割以上になる個数で値を並べ、シャッフルしてゴールにする
+		void fillGoal(Board& board, Random& random) {
+			const int32 cells = board.width * board.height;
+			const int32 minimum = (cells + 9) / 10;
+			std::array<int32, 4> counts;
+			counts.fill(minimum);
+			for (int32 rest = cells - 4 * minimum; rest > 0; --rest) {
+				++counts[random.below(4)];
+			}
+
+			std::vector<int32> values;
+			values.reserve(cells);
+			for (int32 value = 0; value < 4; ++value) {
+				values.insert(values.end(), counts[value], value);
+			}
+			random.shuffle(values.data(), values.size());
+			for (int32 i = 0; i < cells; ++i) {
+				board.goal[i / board.width][i % board.width] = values[i];
+			}
+		}
+
+		// 盤面の cells のマス（index）どうしで、ゴールの値をシャッフルして初期盤面に置く
+		void shuffleCells(Board& board, const std::vector<int32>& cells, Random& random) {
+			std::vector<int32> values;
+			values.reserve(cells.size());
+			for (const int32 index : cells) {
+				values.push_back(board.goal[index / board.width][index % board.width]);
+			}
+			random.shuffle(values.data(), values.size());
+			for (size_t i = 0; i < cells.size(); ++i) {
+				board.grid[cells[i] / board.width][cells[i] % board.width] = values[i];
+			}
+		}
+
+		std::vector<int32> cellRange(int32 begin, int32 end) {
+			std::vector<int32> cells(end - begin);
+			std::iota(cells.begin(), cells.end(), begin);
+			return cells;
+		}
+
+		Board makeBoard(const Settings& settings) {
+			const int32 width = settings.width, height = settings.height;
+			Random random(settings.seed);
+			Board board(width, height);
+			fillGoal(board, random);
+
+			switch (settings.distribution) {
+			case Distribution::Shuffle: {
+				shuffleCells(board, cellRange(0, width * height), random);
+				break;
+			}
+			case Distribution::RowPermuted: {
+				std::vector<int32> rows = cellRange(0, height);
+				random.shuffle(rows.data(), rows.size());
+				for (int32 y = 0; y < height; ++y) {
+					for (int32 x = 0; x < width; ++x) {
+						board.grid[y][x] = board.goal[rows[y]][x];
+					}
+				}
+				break;
+			}
+			case Distribution::ColumnPermuted: {
+				std::vector<int32> columns = cellRange(0, width);
+				random.shuffle(columns.data(), columns.size());
+				for (int32 y = 0; y < height; ++y) {
+					for (int32 x = 0; x < width; ++x) {
+						board.grid[y][x] = board.goal[y][columns[x]];
+					}
+				}
+				break;
+			}
+			case Distribution::BlockShuffled: {
+				// 収まりきる分のブロックを並べ替え、右端・下端の余りはその中でシャッフルする
+				const int32 size = settings.blockSize;
+				const int32 columns = width / size, rows = height / size;
+				std::vector<int32> blocks = cellRange(0, columns * rows);
+				random.shuffle(blocks.data(), blocks.size());
+				for (int32 block = 0; block < columns * rows; ++block) {
+					const int32 toX = block % columns * size, toY = block / columns * size;
+					const int32 fromX = blocks[block] % columns * size, fromY = blocks[block] / columns * size;
+					for (int32 dy = 0; dy < size; ++dy) {
+						for (int32 dx = 0; dx < size; ++dx) {
+							board.grid[toY + dy][toX + dx] = board.goal[fromY + dy][fromX + dx];
+						}
+					}
+				}
+				std::vector<int32> rest;
+				for (int32 y = 0; y < height; ++y) {
+					for (int32 x = 0; x < width; ++x) {
+						if (x >= columns * size || y >= rows * size) rest.push_back(y * width + x);
+					}
+				}
+				shuffleCells(board, rest, random);
+				break;
+			}
+			case Distribution::PartiallySolved: {
+				const int32 solvedRows = std::clamp(static_cast<int32>(std::lround(settings.solvedRatio * height)), 0, height);
+				for (int32 y = 0; y < solvedRows; ++y) {
+					for (int32 x = 0; x < width; ++x) {
+						board.grid[y][x] = board.goal[y][x];
+					}
+				}
+				shuffleCells(board, cellRange(solvedRows * width, width * height), random);
+				break;
+			}
+			}
+			return board;
+		}
+	}
+
+	const char32_t* distributionName(Distribution distribution) {
+		for (const auto& [value, name] : DistributionNames) {
+			if (value == distribution) return name;
+		}
+		return U"unknown";
+	}
+
+	bool parseDistribution(StringView name, Distribution& distribution) {
+		for (const auto& [value, distributionName] : DistributionNames) {
+			if (name == distributionName) {
+				distribution = value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	Board generateBoard(int32 width, int32 height, Distribution distribution, uint64 seed) {
+		Settings settings;
+		settings.width = width;
+		settings.height = height;
+		settings.distribution = distribution;
+		settings.seed = seed;
+		return makeBoard(settings);
+	}
+
+	Array<Pattern> generatePatterns(int32 count, int32 maxSize, uint64 seed) {
+		Random random(seed);
+		Array<Pattern> patterns;
+		for (int32 i = 0; i < count; ++i) {
+			const int32 width = 1 + static_cast<int32>(random.below(maxSize));
+			const int32 height = 1 + static_cast<int32>(random.below(maxSize));
+			Grid<int32> grid(width, height, 0);
+			bool any = false;
+			for (int32 y = 0; y < height; ++y) {
+				for (int32 x = 0; x < width; ++x) {
+					grid[y][x] = static_cast<int32>(random.below(2));
+					any = any || grid[y][x] == 1;
+				}
+			}
+			if (!any) {
+				grid[random.below(height)][random.below(width)] = 1;
+			}
+			patterns << Pattern(grid, 25 + i);
+		}
+		return patterns;
+	}
+
+	Problem generate(const Settings& settings) {
+		auto inRange = [](int32 value, int32 minimum, int32 maximum) {
+			return minimum <= value && value <= maximum;
+		};
+		if (!inRange(settings.width, MinBoardSize, MaxBoardSize) || !inRange(settings.height, MinBoardSize, MaxBoardSize)) {
+			throw Error(U"Board size must be between {} and {}"_fmt(MinBoardSize, MaxBoardSize));
+		}
+		if (!inRange(settings.generalCount, 0, MaxGeneralPatterns) || !inRange(settings.maxPatternSize, 1, MaxPatternSize)) {
+			throw Error(U"General patterns must be at most {} with sides up to {}"_fmt(MaxGeneralPatterns, MaxPatternSize));
+		}
+		if (settings.distribution == Distribution::BlockShuffled && !inRange(settings.blockSize, 1, Min(settings.width, settings.height))) {
+			throw Error(U"Block size must fit in the board");
+		}
+		if (!(0.0 <= settings.solvedRatio && settings.solvedRatio <= 1.0)) {
+			throw Error(U"Solved ratio must be between 0 and 1");
+		}
+
+		return { makeBoard(settings), generatePatterns(settings.generalCount, settings.maxPatternSize, settings.seed + PatternSeedOffset) };
+	}
+
+	JSON Problem::toJSON() const {
+		Array<JSON> patterns;
+		for (const auto& pattern : general) {
+			patterns << pattern.toJSON();
+		}
+
+		JSON json;
+		json[U"board"] = board.toJSON();
+		json[U"general"][U"n"] = static_cast<int32>(general.size());
+		json[U"general"][U"patterns"] = patterns;
+		return json;
+	}
+}
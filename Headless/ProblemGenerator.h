@@ -0,0 +1,99 @@
+﻿// ProblemGenerator.h
+// 乱数の種から問題（盤面）を作る。同じ種・設定なら環境によらず同じ問題になる
+
+#pragma once
+#include "Core.h"
+#include "Pattern.h"
+#include "Board.h"
+
+namespace ProblemGenerator {
+
+	// 初期盤面の作り方
+	enum class Distribution {
+		// ゴールのマスを全体でシャッフル
+		Shuffle,
+		// ゴールの行を並べ替える
+		RowPermuted,
+		// ゴールの列を並べ替える
+		ColumnPermuted,
+		// ゴールを正方形のブロックに分けてブロックを並べ替える
+		BlockShuffled,
+		// 上の何行かは揃っていて、残りをシャッフル
+		PartiallySolved,
+	};
+
+	// 公式の制約（一辺 32〜256、一般抜き型は 256 個まで・一辺 256 まで）
+	constexpr int32 MinBoardSize = 32;
+	constexpr int32 MaxBoardSize = 256;
+	constexpr int32 MaxGeneralPatterns = 256;
+	constexpr int32 MaxPatternSize = 256;
+
+	struct Settings {
+		int32 width = 256;
+		int32 height = 256;
+		Distribution distribution = Distribution::Shuffle;
+		uint64 seed = 1;
+		// BlockShuffled のブロックの一辺
+		int32 blockSize = 8;
+		// PartiallySolved で揃っている行の割合
+		double solvedRatio = 0.5;
+		// 一般抜き型の数と、一辺の最大
+		int32 generalCount = 0;
+		int32 maxPatternSize = 32;
+	};
+
+	// 盤面と一般抜き型
+	struct Problem {
+		Board board;
+		Array<Pattern> general;
+
+		// 問題の JSON（{"board": {...}, "general": {"n", "patterns": [...]}}）
+		JSON toJSON() const;
+	};
+
+	// 名前（"shuffle" など）との変換。知らない名前なら false
+	const char32_t* distributionName(Distribution distribution);
+	bool parseDistribution(StringView name, Distribution& distribution);
+
+	// 環境によらない乱数（splitmix64）
+	class Random {
+	public:
+		explicit Random(uint64 seed) : m_state(seed) {}
+
+		uint64 next() {
+			uint64 z = (m_state += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			return z ^ (z >> 31);
+		}
+
+		// [0, n) の一様な整数
+		uint64 below(uint64 n) {
+			const uint64 limit = std::numeric_limits<uint64>::max() - std::numeric_limits<uint64>::max() % n;
+			uint64 value;
+			do {
+				value = next();
+			} while (value >= limit);
+			return value % n;
+		}
+
+		template <class T>
+		void shuffle(T* first, size_t count) {
+			for (size_t i = count; i > 1; --i) {
+				std::swap(first[i - 1], first[below(i)]);
+			}
+		}
+
+	private:
+		uint64 m_state;
+	};
+
+	// ゴールは 0〜3 がそれぞれ1割以上になるように作り、初期盤面はその並べ替え
+	Board generateBoard(int32 width, int32 height, Distribution distribution, uint64 seed);
+
+	// 一般抜き型（番号は 25 から）。各抜き型には 1 のマスが少なくとも1つある
+	Array<Pattern> generatePatterns(int32 count, int32 maxSize, uint64 seed);
+
+	// 設定どおりの問題を作る。設定が制約の外なら Error
+	Problem generate(const Settings& settings);
+}
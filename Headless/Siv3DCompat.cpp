@@ -0,0 +1,492 @@
+﻿// Siv3DCompat.cpp
+
+#include "Siv3DCompat.h"
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+
+namespace s3d {
+
+	namespace Unicode {
+		String FromUTF8(std::string_view s) {
+			String result;
+			result.reserve(s.size());
+			for (size_t i = 0; i < s.size();) {
+				const auto lead = static_cast<unsigned char>(s[i]);
+				const int32 length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+				if (length == 0 || s.size() < i + length) {
+					// 壊れたバイト列は置換文字にする
+					result += U'�';
+					++i;
+					continue;
+				}
+				char32_t codePoint = length == 1 ? lead : (lead & (0x7F >> length));
+				for (int32 k = 1; k < length; ++k) {
+					codePoint = (codePoint << 6) | (static_cast<unsigned char>(s[i + k]) & 0x3F);
+				}
+				result += codePoint;
+				i += length;
+			}
+			return result;
+		}
+
+		std::string ToUTF8(StringView s) {
+			std::string result;
+			result.reserve(s.size());
+			for (const char32_t c : s) {
+				if (c < 0x80) {
+					result += static_cast<char>(c);
+				}
+				else if (c < 0x800) {
+					result += static_cast<char>(0xC0 | (c >> 6));
+					result += static_cast<char>(0x80 | (c & 0x3F));
+				}
+				else if (c < 0x10000) {
+					result += static_cast<char>(0xE0 | (c >> 12));
+					result += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+					result += static_cast<char>(0x80 | (c & 0x3F));
+				}
+				else {
+					result += static_cast<char>(0xF0 | (c >> 18));
+					result += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+					result += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+					result += static_cast<char>(0x80 | (c & 0x3F));
+				}
+			}
+			return result;
+		}
+	}
+
+	namespace detail {
+		void AppendValue(String& out, const String& value) { out += value; }
+		void AppendValue(String& out, StringView value) { out += value; }
+		void AppendValue(String& out, const char32_t* value) { out += value; }
+		void AppendValue(String& out, const std::string& value) { out += Unicode::FromUTF8(value); }
+		void AppendValue(String& out, const char* value) { out += Unicode::FromUTF8(value); }
+		void AppendValue(String& out, bool value) { out += value ? U"true" : U"false"; }
+		void AppendValue(String& out, char32_t value) { out += value; }
+
+		void AppendValue(String& out, double value) {
+			std::ostringstream stream;
+			stream << value;
+			out += Unicode::FromUTF8(stream.str());
+		}
+
+		void AppendValue(String& out, const Point& value) {
+			out += U'(';
+			AppendValue(out, value.x);
+			out += U", ";
+			AppendValue(out, value.y);
+			out += U')';
+		}
+
+		void AppendValue(String& out, const JSON& value) { out += value.format(); }
+
+		ConsoleLine::~ConsoleLine() {
+			if (!m_enabled) return;
+			const std::string line = Unicode::ToUTF8(m_line) + '\n';
+			// 複数スレッドからの出力が混ざらないよう1回で書く
+			std::fwrite(line.data(), 1, line.size(), stderr);
+		}
+	}
+
+	String FormatString::apply(const std::vector<String>& values) const {
+		String result;
+		size_t next = 0;
+		for (size_t i = 0; i < m_format.size(); ++i) {
+			const char32_t c = m_format[i];
+			const bool doubled = i + 1 < m_format.size() && m_format[i + 1] == c;
+			if ((c == U'{' || c == U'}') && doubled) {
+				result += c;
+				++i;
+			}
+			else if (c == U'{' && i + 1 < m_format.size() && m_format[i + 1] == U'}') {
+				if (next < values.size()) result += values[next++];
+				++i;
+			}
+			else {
+				result += c;
+			}
+		}
+		return result;
+	}
+
+	// JSON
+
+	JSON::JSON(const JSON& other)
+		: m_type(other.m_type), m_integer(other.m_integer), m_number(other.m_number), m_string(other.m_string)
+		, m_array(other.m_array ? std::make_unique<Array<JSON>>(*other.m_array) : nullptr)
+		, m_object(other.m_object ? std::make_unique<std::vector<std::pair<String, JSON>>>(*other.m_object) : nullptr) {}
+
+	JSON& JSON::operator=(const JSON& other) {
+		// other が自分の中の値でも壊さないように、複製してから入れ替える
+		if (this != &other) *this = JSON(other);
+		return *this;
+	}
+
+	JSON::JSON(const Array<JSON>& values)
+		: m_type(Type::Array), m_array(std::make_unique<Array<JSON>>(values)) {}
+
+	JSON::JSON(Array<JSON>&& values)
+		: m_type(Type::Array), m_array(std::make_unique<Array<JSON>>(std::move(values))) {}
+
+	bool JSON::hasElement(StringView key) const {
+		if (m_type != Type::Object) return false;
+		for (const auto& [name, value] : *m_object) {
+			if (name == key) return true;
+		}
+		return false;
+	}
+
+	const JSON& JSON::operator[](StringView key) const {
+		static const JSON null;
+		if (m_type != Type::Object) return null;
+		for (const auto& [name, value] : *m_object) {
+			if (name == key) return value;
+		}
+		return null;
+	}
+
+	JSON& JSON::operator[](StringView key) {
+		if (m_type != Type::Object) {
+			*this = JSON();
+			m_type = Type::Object;
+			m_object = std::make_unique<std::vector<std::pair<String, JSON>>>();
+		}
+		for (auto& [name, value] : *m_object) {
+			if (name == key) return value;
+		}
+		m_object->emplace_back(String(key), JSON());
+		return m_object->back().second;
+	}
+
+	const JSON& JSON::operator[](size_t index) const {
+		if (m_type != Type::Array || m_array->size() <= index) {
+			throw Error(U"JSON: index out of range");
+		}
+		return (*m_array)[index];
+	}
+
+	size_t JSON::size() const noexcept {
+		if (m_type == Type::Array) return m_array->size();
+		if (m_type == Type::Object) return m_object->size();
+		return 0;
+	}
+
+	const Array<JSON>& JSON::arrayView() const {
+		if (m_type != Type::Array) throwTypeError();
+		return *m_array;
+	}
+
+	const String& JSON::getString() const {
+		if (m_type != Type::String) throwTypeError();
+		return m_string;
+	}
+
+	void JSON::push_back(const JSON& value) {
+		if (m_type != Type::Array) {
+			*this = JSON(Array<JSON>());
+		}
+		m_array->push_back(value);
+	}
+
+	void JSON::throwTypeError() const {
+		throw Error(U"JSON: unexpected value type");
+	}
+
+	namespace {
+		void WriteEscaped(std::string& out, const String& text) {
+			out += '"';
+			for (const char32_t c : text) {
+				switch (c) {
+				case U'"': out += "\\\""; break;
+				case U'\\': out += "\\\\"; break;
+				case U'\n': out += "\\n"; break;
+				case U'\r': out += "\\r"; break;
+				case U'\t': out += "\\t"; break;
+				case U'\b': out += "\\b"; break;
+				case U'\f': out += "\\f"; break;
+				default:
+					if (c < 0x20) {
+						char buffer[8];
+						std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned>(c));
+						out += buffer;
+					}
+					else {
+						out += Unicode::ToUTF8(StringView(&c, 1));
+					}
+				}
+			}
+			out += '"';
+		}
+
+		void WriteNewline(std::string& out, int32 indent, int32 depth) {
+			if (indent <= 0) return;
+			out += '\n';
+			out.append(static_cast<size_t>(indent) * depth, ' ');
+		}
+	}
+
+	void JSON::write(std::string& out, int32 indent, int32 depth) const {
+		switch (m_type) {
+		case Type::Null:
+			out += "null";
+			break;
+		case Type::Bool:
+			out += m_integer ? "true" : "false";
+			break;
+		case Type::Integer:
+			out += std::to_string(m_integer);
+			break;
+		case Type::Number: {
+			if (!std::isfinite(m_number)) {
+				out += "null";
+				break;
+			}
+			char buffer[32];
+			const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), m_number);
+			out.append(buffer, end);
+			break;
+		}
+		case Type::String:
+			WriteEscaped(out, m_string);
+			break;
+		case Type::Array:
+			out += '[';
+			for (size_t i = 0; i < m_array->size(); ++i) {
+				if (i) out += ',';
+				WriteNewline(out, indent, depth + 1);
+				(*m_array)[i].write(out, indent, depth + 1);
+			}
+			if (!m_array->empty()) WriteNewline(out, indent, depth);
+			out += ']';
+			break;
+		case Type::Object:
+			out += '{';
+			for (size_t i = 0; i < m_object->size(); ++i) {
+				if (i) out += ',';
+				WriteNewline(out, indent, depth + 1);
+				WriteEscaped(out, (*m_object)[i].first);
+				out += indent > 0 ? ": " : ":";
+				(*m_object)[i].second.write(out, indent, depth + 1);
+			}
+			if (!m_object->empty()) WriteNewline(out, indent, depth);
+			out += '}';
+			break;
+		}
+	}
+
+	String JSON::format(int32 indent) const {
+		return Unicode::FromUTF8(formatUTF8(indent));
+	}
+
+	std::string JSON::formatUTF8(int32 indent) const {
+		std::string out;
+		write(out, indent, 0);
+		return out;
+	}
+
+	bool JSON::save(const FilePath& path) const {
+		std::ofstream file(Unicode::ToUTF8(path), std::ios::binary);
+		if (!file) return false;
+		file << formatUTF8() << '\n';
+		return static_cast<bool>(file);
+	}
+
+	// 再帰下降の JSON パーサ（失敗したら Error）
+	class JSONParser {
+	public:
+		explicit JSONParser(std::string_view text) : m_text(text) {}
+
+		JSON parseDocument() {
+			JSON value = parseValue(0);
+			skipSpaces();
+			if (m_pos != m_text.size()) fail("trailing characters");
+			return value;
+		}
+
+	private:
+		static constexpr int32 MaxDepth = 256;
+
+		std::string_view m_text;
+		size_t m_pos = 0;
+
+		[[noreturn]] void fail(const char* reason) const {
+			throw Error(U"JSON parse error at byte {}: {}"_fmt(m_pos, reason));
+		}
+
+		void skipSpaces() {
+			while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r')) ++m_pos;
+		}
+
+		bool consume(char c) {
+			skipSpaces();
+			if (m_pos < m_text.size() && m_text[m_pos] == c) {
+				++m_pos;
+				return true;
+			}
+			return false;
+		}
+
+		void expect(char c) {
+			if (!consume(c)) fail("unexpected character");
+		}
+
+		bool consumeWord(std::string_view word) {
+			if (m_text.substr(m_pos, word.size()) != word) return false;
+			m_pos += word.size();
+			return true;
+		}
+
+		JSON parseValue(int32 depth) {
+			if (MaxDepth < depth) fail("nesting too deep");
+			skipSpaces();
+			if (m_text.size() <= m_pos) fail("unexpected end");
+
+			switch (m_text[m_pos]) {
+			case '{': return parseObject(depth);
+			case '[': return parseArray(depth);
+			case '"': return JSON(parseString());
+			default: break;
+			}
+			if (consumeWord("true")) return JSON(true);
+			if (consumeWord("false")) return JSON(false);
+			if (consumeWord("null")) return JSON();
+			return parseNumber();
+		}
+
+		JSON parseObject(int32 depth) {
+			expect('{');
+			JSON object;
+			object.m_type = JSON::Type::Object;
+			object.m_object = std::make_unique<std::vector<std::pair<String, JSON>>>();
+			if (consume('}')) return object;
+			do {
+				skipSpaces();
+				if (m_text.size() <= m_pos || m_text[m_pos] != '"') fail("expected a key");
+				String key = parseString();
+				expect(':');
+				object.m_object->emplace_back(std::move(key), parseValue(depth + 1));
+			} while (consume(','));
+			expect('}');
+			return object;
+		}
+
+		JSON parseArray(int32 depth) {
+			expect('[');
+			Array<JSON> values;
+			if (consume(']')) return JSON(std::move(values));
+			do {
+				values.push_back(parseValue(depth + 1));
+			} while (consume(','));
+			expect(']');
+			return JSON(std::move(values));
+		}
+
+		uint32 parseHex4() {
+			if (m_text.size() < m_pos + 4) fail("truncated escape");
+			uint32 value = 0;
+			for (int32 i = 0; i < 4; ++i) {
+				const char c = m_text[m_pos++];
+				value <<= 4;
+				if ('0' <= c && c <= '9') value |= c - '0';
+				else if ('a' <= c && c <= 'f') value |= c - 'a' + 10;
+				else if ('A' <= c && c <= 'F') value |= c - 'A' + 10;
+				else fail("invalid escape");
+			}
+			return value;
+		}
+
+		String parseString() {
+			++m_pos;
+			std::string bytes;
+			String result;
+			auto flush = [&] {
+				result += Unicode::FromUTF8(bytes);
+				bytes.clear();
+			};
+			while (true) {
+				if (m_text.size() <= m_pos) fail("unterminated string");
+				const char c = m_text[m_pos++];
+				if (c == '"') break;
+				if (c != '\\') {
+					bytes += c;
+					continue;
+				}
+				if (m_text.size() <= m_pos) fail("unterminated string");
+				const char escape = m_text[m_pos++];
+				switch (escape) {
+				case '"': bytes += '"'; break;
+				case '\\': bytes += '\\'; break;
+				case '/': bytes += '/'; break;
+				case 'b': bytes += '\b'; break;
+				case 'f': bytes += '\f'; break;
+				case 'n': bytes += '\n'; break;
+				case 'r': bytes += '\r'; break;
+				case 't': bytes += '\t'; break;
+				case 'u': {
+					uint32 codePoint = parseHex4();
+					// サロゲートペア
+					if (0xD800 <= codePoint && codePoint < 0xDC00 && m_text.substr(m_pos, 2) == "\\u") {
+						m_pos += 2;
+						const uint32 low = parseHex4();
+						if (low < 0xDC00 || 0xE000 <= low) fail("invalid surrogate pair");
+						codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+					}
+					flush();
+					result += static_cast<char32_t>(codePoint);
+					break;
+				}
+				default:
+					fail("invalid escape");
+				}
+			}
+			flush();
+			return result;
+		}
+
+		JSON parseNumber() {
+			const size_t begin = m_pos;
+			bool integral = true;
+			while (m_pos < m_text.size()) {
+				const char c = m_text[m_pos];
+				if (c == '.' || c == 'e' || c == 'E') integral = false;
+				else if (!(('0' <= c && c <= '9') || c == '-' || c == '+')) break;
+				++m_pos;
+			}
+			const char* first = m_text.data() + begin;
+			const char* last = m_text.data() + m_pos;
+			if (first == last) fail("unexpected character");
+			if (integral) {
+				int64 value = 0;
+				const auto [end, error] = std::from_chars(first, last, value);
+				if (error == std::errc() && end == last) return JSON(value);
+			}
+			double value = 0.0;
+			const auto [end, error] = std::from_chars(first, last, value);
+			if (error != std::errc() || end != last) fail("invalid number");
+			return JSON(value);
+		}
+	};
+
+	JSON JSON::Parse(StringView text) {
+		return JSONParser(Unicode::ToUTF8(text)).parseDocument();
+	}
+
+	JSON JSON::Load(const FilePath& path) {
+		// Siv3D と同じく、開けない・読めないときは空の JSON を返す
+		std::ifstream file(Unicode::ToUTF8(path), std::ios::binary);
+		if (!file) return JSON();
+		std::ostringstream stream;
+		stream << file.rdbuf();
+		std::string text = stream.str();
+		if (text.starts_with("\xEF\xBB\xBF")) text.erase(0, 3);
+		try {
+			return JSONParser(text).parseDocument();
+		}
+		catch (const Error& error) {
+			Console << U"JSON::Load: " << error.what();
+			return JSON();
+		}
+	}
+}
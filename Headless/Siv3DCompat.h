@@ -0,0 +1,417 @@
+﻿// Siv3DCompat.h
+// ヘッドレス版（PROCON_HEADLESS）で Siv3D の代わりに使う最小限の互換層
+// 盤面・抜き型・Algorithm が使う型と関数だけを標準ライブラリで実装する（描画・ウィンドウ・通信はない）
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace s3d {
+
+	using int8 = std::int8_t;
+	using int16 = std::int16_t;
+	using int32 = std::int32_t;
+	using int64 = std::int64_t;
+	using uint8 = std::uint8_t;
+	using uint16 = std::uint16_t;
+	using uint32 = std::uint32_t;
+	using uint64 = std::uint64_t;
+
+	// 文字列は UTF-32
+	using String = std::u32string;
+	using StringView = std::u32string_view;
+	using FilePath = String;
+
+	namespace Unicode {
+		String FromUTF8(std::string_view s);
+		std::string ToUTF8(StringView s);
+	}
+
+	template <class T>
+	[[nodiscard]] constexpr T Max(const T& a, const T& b) { return (a < b) ? b : a; }
+
+	template <class T>
+	[[nodiscard]] constexpr T Min(const T& a, const T& b) { return (b < a) ? b : a; }
+
+	// 動的配列
+	template <class T>
+	class Array : public std::vector<T> {
+	public:
+		using std::vector<T>::vector;
+
+		Array() = default;
+
+		Array(const std::vector<T>& other) : std::vector<T>(other) {}
+
+		Array(std::vector<T>&& other) : std::vector<T>(std::move(other)) {}
+
+		Array& operator<<(const T& value) {
+			this->push_back(value);
+			return *this;
+		}
+
+		Array& operator<<(T&& value) {
+			this->push_back(std::move(value));
+			return *this;
+		}
+
+		[[nodiscard]] bool isEmpty() const noexcept { return this->empty(); }
+
+		Array& reverse() {
+			std::reverse(this->begin(), this->end());
+			return *this;
+		}
+
+		// 先頭 n 個
+		[[nodiscard]] Array take(size_t n) const {
+			return Array(this->begin(), this->begin() + Min(n, this->size()));
+		}
+	};
+
+	struct Point {
+		int32 x = 0;
+		int32 y = 0;
+
+		constexpr Point() = default;
+		constexpr Point(int32 _x, int32 _y) : x(_x), y(_y) {}
+
+		[[nodiscard]] constexpr bool operator==(const Point& other) const = default;
+		[[nodiscard]] constexpr Point operator+(const Point& other) const { return { x + other.x, y + other.y }; }
+		[[nodiscard]] constexpr Point operator-(const Point& other) const { return { x - other.x, y - other.y }; }
+	};
+
+	using Size = Point;
+
+	// 2次元配列（grid[y][x]）
+	template <class T>
+	class Grid {
+	public:
+		// vector<bool> を避けて、bool も1要素1バイトで持つ
+		using value_type = std::conditional_t<std::is_same_v<T, bool>, uint8, T>;
+		using size_type = size_t;
+
+		Grid() = default;
+
+		Grid(size_type w, size_type h, const T& value = T())
+			: m_data(w * h, static_cast<value_type>(value)), m_width(w), m_height(h) {}
+
+		[[nodiscard]] value_type* operator[](size_type y) { return m_data.data() + y * m_width; }
+		[[nodiscard]] const value_type* operator[](size_type y) const { return m_data.data() + y * m_width; }
+		[[nodiscard]] value_type& operator[](const Point& pos) { return m_data[static_cast<size_type>(pos.y) * m_width + pos.x]; }
+		[[nodiscard]] const value_type& operator[](const Point& pos) const { return m_data[static_cast<size_type>(pos.y) * m_width + pos.x]; }
+
+		[[nodiscard]] size_type width() const noexcept { return m_width; }
+		[[nodiscard]] size_type height() const noexcept { return m_height; }
+		[[nodiscard]] Size size() const noexcept { return { static_cast<int32>(m_width), static_cast<int32>(m_height) }; }
+		[[nodiscard]] size_type num_elements() const noexcept { return m_data.size(); }
+		[[nodiscard]] bool isEmpty() const noexcept { return m_data.empty(); }
+
+		[[nodiscard]] bool inBounds(int64 y, int64 x) const noexcept {
+			return 0 <= y && y < static_cast<int64>(m_height) && 0 <= x && x < static_cast<int64>(m_width);
+		}
+
+		void fill(const T& value) { std::fill(m_data.begin(), m_data.end(), static_cast<value_type>(value)); }
+
+		auto begin() noexcept { return m_data.begin(); }
+		auto end() noexcept { return m_data.end(); }
+		auto begin() const noexcept { return m_data.begin(); }
+		auto end() const noexcept { return m_data.end(); }
+
+		[[nodiscard]] bool operator==(const Grid& other) const = default;
+
+	private:
+		std::vector<value_type> m_data;
+		size_type m_width = 0;
+		size_type m_height = 0;
+	};
+
+	// for (auto i : step(n)) で 0, 1, ..., n - 1
+	template <class T>
+	class StepRange {
+	public:
+		class Iterator {
+		public:
+			constexpr explicit Iterator(T value) : m_value(value) {}
+			constexpr T operator*() const { return m_value; }
+			constexpr Iterator& operator++() { ++m_value; return *this; }
+			constexpr bool operator!=(const Iterator& other) const { return m_value != other.m_value; }
+		private:
+			T m_value;
+		};
+
+		constexpr explicit StepRange(T count) : m_count(count) {
+			if constexpr (std::is_signed_v<T>) {
+				if (m_count < T(0)) m_count = T(0);
+			}
+		}
+		constexpr Iterator begin() const { return Iterator(T(0)); }
+		constexpr Iterator end() const { return Iterator(m_count); }
+
+	private:
+		T m_count;
+	};
+
+	template <class T>
+	[[nodiscard]] constexpr StepRange<T> step(T count) { return StepRange<T>(count); }
+
+	// 例外（what() はメッセージを返す）
+	class Error {
+	public:
+		Error() = default;
+		explicit Error(StringView message) : m_message(message) {}
+		[[nodiscard]] const String& what() const noexcept { return m_message; }
+	private:
+		String m_message;
+	};
+
+	class JSON;
+
+	namespace detail {
+		// 文字列化（Console・_fmt 用）
+		void AppendValue(String& out, const String& value);
+		void AppendValue(String& out, StringView value);
+		void AppendValue(String& out, const char32_t* value);
+		void AppendValue(String& out, const std::string& value);
+		void AppendValue(String& out, const char* value);
+		void AppendValue(String& out, bool value);
+		void AppendValue(String& out, char32_t value);
+		void AppendValue(String& out, double value);
+		void AppendValue(String& out, const Point& value);
+		void AppendValue(String& out, const JSON& value);
+
+		template <class T> requires std::is_integral_v<T>
+		void AppendValue(String& out, T value) {
+			const std::string text = std::to_string(value);
+			out.append(text.begin(), text.end());
+		}
+
+		template <class T> requires std::is_floating_point_v<T>
+		void AppendValue(String& out, T value) {
+			AppendValue(out, static_cast<double>(value));
+		}
+
+		template <class T>
+		void AppendValue(String& out, const Array<T>& values) {
+			out += U'{';
+			for (size_t i = 0; i < values.size(); ++i) {
+				if (i) out += U", ";
+				AppendValue(out, values[i]);
+			}
+			out += U'}';
+		}
+
+		template <class T>
+		void AppendValue(String& out, const Grid<T>& grid) {
+			for (size_t y = 0; y < grid.height(); ++y) {
+				for (size_t x = 0; x < grid.width(); ++x) {
+					if (x) out += U' ';
+					AppendValue(out, grid[y][x]);
+				}
+				out += U'\n';
+			}
+		}
+
+		template <class A, class B>
+		void AppendValue(String& out, const std::pair<A, B>& value) {
+			out += U'(';
+			AppendValue(out, value.first);
+			out += U", ";
+			AppendValue(out, value.second);
+			out += U')';
+		}
+
+		// Console << a << b は1行にまとめて、式の終わりで出力する
+		class ConsoleLine {
+		public:
+			explicit ConsoleLine(bool enabled) : m_enabled(enabled) {}
+			ConsoleLine(ConsoleLine&& other) noexcept : m_line(std::move(other.m_line)), m_enabled(std::exchange(other.m_enabled, false)) {}
+			ConsoleLine(const ConsoleLine&) = delete;
+			ConsoleLine& operator=(const ConsoleLine&) = delete;
+			~ConsoleLine();
+
+			template <class T>
+			ConsoleLine& operator<<(const T& value) {
+				if (m_enabled) AppendValue(m_line, value);
+				return *this;
+			}
+
+		private:
+			String m_line;
+			bool m_enabled;
+		};
+
+		class Console_impl {
+		public:
+			template <class T>
+			ConsoleLine operator<<(const T& value) const {
+				ConsoleLine line(isEnabled());
+				line << value;
+				return line;
+			}
+
+			// ヘッドレス版だけの設定。無効なら何も出力しない（既定は有効、出力先は標準エラー）
+			void setEnabled(bool enabled) const { m_enabled.store(enabled, std::memory_order_relaxed); }
+			[[nodiscard]] bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+		private:
+			inline static std::atomic<bool> m_enabled{ true };
+		};
+	}
+
+	inline constexpr detail::Console_impl Console{};
+
+	// U"...{}..."_fmt(args...)（{} を順に置き換える。{{ と }} はそのままの括弧）
+	class FormatString {
+	public:
+		constexpr explicit FormatString(StringView format) : m_format(format) {}
+
+		template <class... Args>
+		[[nodiscard]] String operator()(const Args&... args) const {
+			std::vector<String> values;
+			(values.push_back([&] { String s; detail::AppendValue(s, args); return s; }()), ...);
+			return apply(values);
+		}
+
+	private:
+		String apply(const std::vector<String>& values) const;
+		StringView m_format;
+	};
+
+	inline namespace Literals {
+		[[nodiscard]] constexpr FormatString operator""_fmt(const char32_t* s, size_t length) {
+			return FormatString(StringView(s, length));
+		}
+	}
+
+	// JSON の値（オブジェクトのキーは書き込んだ順を保つ）
+	// コピーは配列・オブジェクトの中身まで複製するので、コピーに書き込んでも元の値は変わらない
+	class JSON {
+	public:
+		enum class Type { Null, Bool, Integer, Number, String, Array, Object };
+
+		JSON() = default;
+		JSON(const JSON& other);
+		JSON(JSON&&) noexcept = default;
+		JSON& operator=(const JSON& other);
+		JSON& operator=(JSON&&) noexcept = default;
+		~JSON() = default;
+
+		JSON(std::nullptr_t) {}
+		JSON(bool value) : m_type(Type::Bool), m_integer(value) {}
+		JSON(int32 value) : m_type(Type::Integer), m_integer(value) {}
+		JSON(int64 value) : m_type(Type::Integer), m_integer(value) {}
+		JSON(uint32 value) : m_type(Type::Integer), m_integer(value) {}
+		JSON(uint64 value) : m_type(Type::Integer), m_integer(static_cast<int64>(value)) {}
+		JSON(double value) : m_type(Type::Number), m_number(value) {}
+		JSON(StringView value) : m_type(Type::String), m_string(value) {}
+		JSON(const String& value) : m_type(Type::String), m_string(value) {}
+		JSON(const char32_t* value) : m_type(Type::String), m_string(value) {}
+		JSON(const Array<JSON>& values);
+		JSON(Array<JSON>&& values);
+
+		template <class T>
+		JSON(const Array<T>& values) : JSON(Array<JSON>(values.begin(), values.end())) {}
+
+		[[nodiscard]] Type getType() const noexcept { return m_type; }
+		[[nodiscard]] bool isNull() const noexcept { return m_type == Type::Null; }
+		[[nodiscard]] bool isBool() const noexcept { return m_type == Type::Bool; }
+		[[nodiscard]] bool isNumber() const noexcept { return m_type == Type::Integer || m_type == Type::Number; }
+		[[nodiscard]] bool isString() const noexcept { return m_type == Type::String; }
+		[[nodiscard]] bool isArray() const noexcept { return m_type == Type::Array; }
+		[[nodiscard]] bool isObject() const noexcept { return m_type == Type::Object; }
+
+		// 読み込みに失敗した JSON は null になる
+		[[nodiscard]] bool isEmpty() const noexcept { return m_type == Type::Null; }
+		[[nodiscard]] explicit operator bool() const noexcept { return !isEmpty(); }
+
+		[[nodiscard]] bool hasElement(StringView key) const;
+
+		// オブジェクトの要素。const 版はないキーなら null を返し、非 const 版は追加する
+		[[nodiscard]] const JSON& operator[](StringView key) const;
+		JSON& operator[](StringView key);
+
+		// 配列の要素
+		[[nodiscard]] const JSON& operator[](size_t index) const;
+
+		[[nodiscard]] size_t size() const noexcept;
+		[[nodiscard]] const Array<JSON>& arrayView() const;
+
+		// 数・真偽値・文字列を取り出す（型が違えば Error）
+		template <class T>
+		[[nodiscard]] T get() const {
+			if constexpr (std::is_same_v<T, bool>) {
+				if (m_type != Type::Bool) throwTypeError();
+				return m_integer != 0;
+			}
+			else if constexpr (std::is_integral_v<T>) {
+				if (m_type == Type::Integer) return static_cast<T>(m_integer);
+				if (m_type == Type::Number) return static_cast<T>(m_number);
+				throwTypeError();
+			}
+			else if constexpr (std::is_floating_point_v<T>) {
+				if (m_type == Type::Integer) return static_cast<T>(m_integer);
+				if (m_type == Type::Number) return static_cast<T>(m_number);
+				throwTypeError();
+			}
+			else if constexpr (std::is_same_v<T, String>) {
+				return getString();
+			}
+			else {
+				static_assert(std::is_same_v<T, void>, "unsupported JSON::get type");
+			}
+		}
+
+		[[nodiscard]] const String& getString() const;
+
+		void push_back(const JSON& value);
+
+		// 整形した文字列（indent 0 なら1行）
+		[[nodiscard]] String format(int32 indent = 2) const;
+		[[nodiscard]] std::string formatUTF8(int32 indent = 2) const;
+		[[nodiscard]] std::string formatUTF8Minimum() const { return formatUTF8(0); }
+
+		bool save(const FilePath& path) const;
+
+		[[nodiscard]] static JSON Parse(StringView text);
+		[[nodiscard]] static JSON Load(const FilePath& path);
+
+	private:
+		[[noreturn]] void throwTypeError() const;
+		void write(std::string& out, int32 indent, int32 depth) const;
+
+		Type m_type = Type::Null;
+		int64 m_integer = 0;
+		double m_number = 0.0;
+		String m_string;
+		std::unique_ptr<Array<JSON>> m_array;
+		std::unique_ptr<std::vector<std::pair<String, JSON>>> m_object;
+
+		friend class JSONParser;
+	};
+
+	using JSONArrayView = const Array<JSON>&;
+}
+
+using namespace s3d;
+using namespace s3d::Literals;
@@ -0,0 +1,220 @@
+﻿// SolverMain.cpp
+// ヘッドレス版のソルバ（問題の JSON を読んで解き、回答の JSON を書く）
+//
+// 使い方: procon_solver <問題.json> [オプション]
+//   -a, --algorithm <名前>   greedy / beam / greedy2 / portfolio / twophase（既定 greedy）
+//   -t, --time <秒>          制限時間（0 なら各アルゴリズムの既定値）
+//   -o, --output <パス>      回答の出力先（既定 answer.json）
+//   -j, --threads <n>        改善貪欲・候補評価のスレッド数（0 なら論理コア数）
+//   --seed <n>               乱数の種（0 ならその都度作る）
+//   --beam-width <n>         ビームサーチの幅
+//   --beam-memory <MiB>      ビームサーチの状態に使うメモリの上限
+//   --row-placement          行の並べ替えの事前処理をする
+//   --orientations           対称な問題も並列に解く
+//   -v, --verbose            ソルバの途中経過を標準エラーに出す
+//
+// 結果（手数・検証・時間）は標準出力に出す。解けなかった・検証に失敗したときは終了コード 1
+
+#include "Core.h"
+#include "Pattern.h"
+#include "StandardPatterns.h"
+#include "Board.h"
+#include "Algorithm.h"
+#include <cstdlib>
+#include <cstdio>
+#include <string_view>
+
+namespace {
+
+	struct AlgorithmEntry {
+		std::string_view name;
+		Algorithm::Type type;
+	};
+
+	// 名前は GUI のアルゴリズム名（小文字）に合わせる
+	constexpr std::array<AlgorithmEntry, 5> Algorithms = { {
+		{ "greedy", Algorithm::Type::Greedy },
+		{ "beam", Algorithm::Type::BeamSearch },
+		{ "greedy2", Algorithm::Type::ImprovedGreedy },
+		{ "portfolio", Algorithm::Type::Portfolio },
+		{ "twophase", Algorithm::Type::TwoPhase },
+	} };
+
+	struct CommandLine {
+		std::string problemPath;
+		std::string outputPath = "answer.json";
+		AlgorithmEntry algorithm = Algorithms[0];
+		Algorithm::Options options;
+		bool verbose = false;
+	};
+
+	void printUsage(std::FILE* out) {
+		std::fputs(
+			"usage: procon_solver <problem.json> [options]\n"
+			"  -a, --algorithm <name>   greedy | beam | greedy2 | portfolio | twophase (default: greedy)\n"
+			"  -t, --time <seconds>     time limit (0: algorithm default)\n"
+			"  -o, --output <path>      answer JSON path (default: answer.json)\n"
+			"  -j, --threads <n>        worker threads (0: hardware concurrency)\n"
+			"      --seed <n>           random seed (0: nondeterministic)\n"
+			"      --beam-width <n>     beam width\n"
+			"      --beam-memory <MiB>  memory budget for beam states\n"
+			"      --row-placement      run the row placement pre-pass\n"
+			"      --orientations       also solve transposed / flipped problems\n"
+			"  -v, --verbose            print solver progress to stderr\n"
+			"  -h, --help               show this help\n", out);
+	}
+
+	// 引数を読む。使い方が間違っていれば false
+	bool parseCommandLine(int argc, char** argv, CommandLine& commandLine) {
+		for (int i = 1; i < argc; ++i) {
+			const std::string_view arg = argv[i];
+			auto value = [&]() -> const char* {
+				if (i + 1 >= argc) {
+					std::fprintf(stderr, "error: %s needs a value\n", argv[i]);
+					return nullptr;
+				}
+				return argv[++i];
+			};
+			auto number = [&](auto& target) {
+				const char* text = value();
+				if (!text) return false;
+				char* end = nullptr;
+				const double parsed = std::strtod(text, &end);
+				if (end == text || *end != '\0' || parsed < 0) {
+					std::fprintf(stderr, "error: invalid value for %s: %s\n", argv[i - 1], text);
+					return false;
+				}
+				target = static_cast<std::remove_reference_t<decltype(target)>>(parsed);
+				return true;
+			};
+
+			if (arg == "-h" || arg == "--help") {
+				printUsage(stdout);
+				std::exit(0);
+			}
+			else if (arg == "-a" || arg == "--algorithm") {
+				const char* name = value();
+				if (!name) return false;
+				const auto found = std::find_if(Algorithms.begin(), Algorithms.end(), [&](const AlgorithmEntry& entry) { return entry.name == name; });
+				if (found == Algorithms.end()) {
+					std::fprintf(stderr, "error: unknown algorithm: %s\n", name);
+					return false;
+				}
+				commandLine.algorithm = *found;
+			}
+			else if (arg == "-t" || arg == "--time") {
+				if (!number(commandLine.options.timeLimit)) return false;
+			}
+			else if (arg == "-o" || arg == "--output") {
+				const char* path = value();
+				if (!path) return false;
+				commandLine.outputPath = path;
+			}
+			else if (arg == "-j" || arg == "--threads") {
+				if (!number(commandLine.options.threads)) return false;
+			}
+			else if (arg == "--seed") {
+				const char* text = value();
+				if (!text) return false;
+				commandLine.options.seed = std::strtoull(text, nullptr, 10);
+			}
+			else if (arg == "--beam-width") {
+				if (!number(commandLine.options.beamWidth)) return false;
+			}
+			else if (arg == "--beam-memory") {
+				double mebibytes = 0;
+				if (!number(mebibytes)) return false;
+				commandLine.options.beamMemoryBudget = static_cast<size_t>(mebibytes * 1024 * 1024);
+			}
+			else if (arg == "--row-placement") {
+				commandLine.options.rowPlacement = true;
+			}
+			else if (arg == "--orientations") {
+				commandLine.options.orientations = true;
+			}
+			else if (arg == "-v" || arg == "--verbose") {
+				commandLine.verbose = true;
+			}
+			else if (!arg.empty() && arg[0] == '-') {
+				std::fprintf(stderr, "error: unknown option: %s\n", argv[i]);
+				return false;
+			}
+			else if (commandLine.problemPath.empty()) {
+				commandLine.problemPath = argv[i];
+			}
+			else {
+				std::fprintf(stderr, "error: unexpected argument: %s\n", argv[i]);
+				return false;
+			}
+		}
+		if (commandLine.problemPath.empty()) {
+			std::fputs("error: no problem file\n", stderr);
+			return false;
+		}
+		return true;
+	}
+
+	struct Problem {
+		Board board;
+		// 定型抜き型のあとに一般抜き型が続く
+		Array<Pattern> patterns;
+		int32 generalCount = 0;
+	};
+
+	// 問題の JSON（{"board": {...}, "general": {"patterns": [...]}}）から盤面と抜き型を作る
+	Problem loadProblem(const FilePath& path) {
+		const JSON json = JSON::Load(path);
+		if (not json) {
+			throw Error(U"Failed to load JSON file: " + path);
+		}
+
+		Problem problem{ Board::fromJSON(json[U"board"]), StandardPatterns::getAllStandardPatterns_Grid() };
+		if (json[U"general"][U"patterns"].isArray()) {
+			for (const auto& patternJson : json[U"general"][U"patterns"].arrayView()) {
+				problem.patterns << Pattern::fromJSON(patternJson);
+				++problem.generalCount;
+			}
+		}
+		return problem;
+	}
+}
+
+int main(int argc, char** argv) {
+	CommandLine commandLine;
+	if (!parseCommandLine(argc, argv, commandLine)) {
+		printUsage(stderr);
+		return 2;
+	}
+	Console.setEnabled(commandLine.verbose);
+
+	try {
+		const auto loadStart = std::chrono::steady_clock::now();
+		const auto [board, patterns, generalCount] = loadProblem(Unicode::FromUTF8(commandLine.problemPath));
+		const double loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+
+		const auto solveStart = std::chrono::steady_clock::now();
+		const Algorithm::Solution solution = Algorithm::solve(commandLine.algorithm.type, board, patterns, commandLine.options);
+		const double solveTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - solveStart).count();
+
+		const bool valid = Algorithm::isValidSolution(board, solution);
+		const bool saved = solution.toJSON().save(Unicode::FromUTF8(commandLine.outputPath));
+
+		std::printf("problem:   %s\n", commandLine.problemPath.c_str());
+		std::printf("board:     %dx%d, general patterns: %d\n", board.width, board.height, generalCount);
+		std::printf("algorithm: %.*s\n", static_cast<int>(commandLine.algorithm.name.size()), commandLine.algorithm.name.data());
+		std::printf("steps:     %zu\n", solution.steps.size());
+		std::printf("valid:     %s\n", valid ? "yes" : "no");
+		std::printf("load:      %.3f s\n", loadTime);
+		std::printf("solve:     %.3f s\n", solveTime);
+		std::printf("output:    %s%s\n", commandLine.outputPath.c_str(), saved ? "" : " (write failed)");
+		return valid && saved ? 0 : 1;
+	}
+	catch (const Error& error) {
+		std::fprintf(stderr, "error: %s\n", Unicode::ToUTF8(error.what()).c_str());
+		return 1;
+	}
+	catch (const std::exception& error) {
+		std::fprintf(stderr, "error: %s\n", error.what());
+		return 1;
+	}
+}
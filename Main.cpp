@@ -144,6 +144,16 @@ void patternDraw(const Array<Pattern>& patterns, int currentPattern, const int c
 	}
 }
 
+// 一致数の多い置き方の枠を描画（1位ほど濃く）
+void bestMovesDraw(const Array<std::pair<Point, int32>>& bestMoves, const Pattern& pattern, const int cellSize, const GameMode& currentMode) {
+	if (currentMode != GameMode::Manual) return;
+	for (size_t i = 0; i < bestMoves.size(); ++i) {
+		const Point& pos = bestMoves[i].first;
+		Rect(pos.x * cellSize, pos.y * cellSize, pattern.grid.width() * cellSize, pattern.grid.height() * cellSize)
+			.drawFrame(2, ColorF(0.0, 0.6, 1.0, 1.0 - 0.15 * i));
+	}
+}
+
 void trainAndDebug(const Array<Pattern>& patterns) {
 	int trainStepSize = 1;
 	Array<int> failedStep;
@@ -251,13 +261,19 @@ void Main() {
 		Algorithm::Type::Greedy,
 		Algorithm::Type::BeamSearch,
 		Algorithm::Type::ImprovedGreedy,
+		Algorithm::Type::Portfolio,
+		Algorithm::Type::TwoPhase,
 	};
-	const Array<String> algorithmNames = { U"Greedy", U"BeamSearch", U"Greedy2" };
+	const Array<String> algorithmNames = { U"Greedy", U"BeamSearch", U"Greedy2", U"Portfolio", U"TwoPhase" };
 
 	// モード設定
 	GameMode currentMode = GameMode::Manual;
 	int32 currentAlgorithm = 0;
 
+	// 探索の設定
+	// p キーで行の並べ替え（事前処理）、o キーで対称な問題の並列探索を切り替え
+	Algorithm::Options algorithmOptions;
+
 	// ボタン設定
 	RoundRect manualButton(BUTTON_X, BUTTON_Y(1), BUTTON_WIDTH, BUTTON_HEIGHT, BUTTON_ROUND);
 	RoundRect algorithmButton(BUTTON_X, BUTTON_Y(2), BUTTON_WIDTH, BUTTON_HEIGHT, BUTTON_ROUND);
@@ -274,6 +290,16 @@ void Main() {
 	// m キーで切り替え
 	bool readMouseInput = 1; // 1 -> 入力
 
+	// 現在の抜き型・方向で一致数の多い置き方（人力操作モードで表示）
+	// 盤面か抜き型か方向が変わったら裏で全位置をまとめて評価し直す
+	// （変えた所で bestMovesDirty を立てる）
+	// k キーで表示を切り替え
+	constexpr size_t BestMoveCount = 5;
+	bool showBestMoves = true;
+	Array<std::pair<Point, int32>> bestMoves;
+	bool bestMovesDirty = true;
+	AsyncTask<Array<std::pair<Point, int32>>> bestMovesTask;
+
 	// 進度
 	double progress = 100.0 * (1.0 - double(board.calculateDifference(board.grid)) / double((board.height * board.width)));
 	double nextProgress = progress;
@@ -320,6 +346,7 @@ void Main() {
 				// 非同期タスクが終了したら
 				if (task.isReady()) {
 					board = task.get().first;
+					bestMovesDirty = true;
 				}
 
 				// 進度初期化
@@ -420,6 +447,7 @@ void Main() {
 					board.apply_pattern(pattern, point, direction);
 					answer.steps.emplace_back(action);
 				}
+				bestMovesDirty = true;
 			}
 
 		}
@@ -431,6 +459,22 @@ void Main() {
 				readMouseInput ^= 1;
 			}
 
+			// 最善手の表示を切り替え
+			if (KeyK.down()) {
+				showBestMoves ^= 1;
+			}
+
+			// 評価が終わっていれば受け取り、盤面・抜き型・方向が変わっていれば評価し直す
+			if (bestMovesTask.isReady()) {
+				bestMoves = bestMovesTask.get();
+			}
+			if (showBestMoves && bestMovesDirty && !bestMovesTask.isValid()) {
+				bestMovesDirty = false;
+				bestMovesTask = Async([board = board, pattern = patterns[currentPattern], direction]() {
+					return Algorithm::scorePlacements(board, pattern, direction).top(BestMoveCount);
+				});
+			}
+
 			// マウス入力オン & マウスが盤面の上にある & マウスが動いたら
 			// マウス座標に抜き型を置く
 			if (readMouseInput && isMouseOnBoard()) {
@@ -448,11 +492,16 @@ void Main() {
 						patternHeight = patterns[currentPattern].grid.height();
 						patternWidth = patterns[currentPattern].grid.width();
 						patternPos = Point(0, 0);
+						bestMovesDirty = true;
+					}
+					if (KeyR.down()) {
+						direction = (direction + 1) % 4;
+						bestMovesDirty = true;
 					}
-					if (KeyR.down()) direction = (direction + 1) % 4;
 					if (KeySpace.down() || MouseL.down()) {
 						board.apply_pattern(patterns[currentPattern], patternPos, direction);
 						answer.steps.emplace_back(patterns[currentPattern], patternPos, direction);
+						bestMovesDirty = true;
 					}
 					progress = 100.0 * (1.0 - double(board.calculateDifference(board.grid)) / double((board.height * board.width)));
 					nextProgress = 100.0 * board.calculateNextProgress(patterns[currentPattern], patternPos, direction) / double(board.height * board.width);
@@ -467,10 +516,42 @@ void Main() {
 				currentAlgorithm = (currentAlgorithm + 1) % algorithms.size();
 			}
 
+			// 行の並べ替えを切り替え
+			if (KeyP.down()) {
+				algorithmOptions.rowPlacement = !algorithmOptions.rowPlacement;
+			}
+
+			// 対称な問題の並列探索を切り替え
+			if (KeyO.down()) {
+				algorithmOptions.orientations = !algorithmOptions.orientations;
+			}
+
+			// ヘッドレス版のソルバが書いた回答（answer.json）を読み込んで適用する
+			if (KeyL.down()) {
+				try {
+					const JSON answerJson = JSON::Load(U"answer.json");
+					if (not answerJson) {
+						throw Error(U"Failed to load answer.json");
+					}
+					const auto solution = Algorithm::Solution::fromJSON(answerJson, patterns);
+					for (const auto& action : solution.steps) {
+						const auto& [solvePattern, solvePos, solveDir] = action;
+						answer.steps.emplace_back(action);
+						board.apply_pattern(solvePattern, solvePos, solveDir);
+					}
+					bestMovesDirty = true;
+					Console << U"answer.json: " << solution.steps.size() << U" steps";
+				}
+				catch (const Error& error) {
+					Console << U"Error loading answer: " << error.what();
+				}
+				progress = 100.0 * (1.0 - double(board.calculateDifference(board.grid)) / double((board.height * board.width)));
+			}
+
 			// アルゴリズムを実行
 			if (KeySpace.down()) {
 				auto startTime = std::chrono::high_resolution_clock::now();
-				auto solution = Algorithm::solve(algorithms[currentAlgorithm], board, patterns);
+				auto solution = Algorithm::solve(algorithms[currentAlgorithm], board, patterns, algorithmOptions);
 				auto endTime = std::chrono::high_resolution_clock::now();
 				double elapsedTime = std::chrono::duration<double>(endTime - startTime).count();
 				Console << U"Time taken: " << elapsedTime << U" seconds";
@@ -485,6 +566,7 @@ void Main() {
 					/*board.draw();
 					System::Update();*/
 				}
+				bestMovesDirty = true;
 				Console << directionCount;
 
 				progress = 100.0 * (1.0 - double(board.calculateDifference(board.grid)) / double((board.height * board.width)));
@@ -517,7 +599,9 @@ void Main() {
 		// モード文字列の取得
 		const String modeString = currentMode == GameMode::Manual
 			? U"Manual"
-			: algorithmNames[currentAlgorithm];
+			: algorithmNames[currentAlgorithm]
+				+ (algorithmOptions.rowPlacement ? U" +Rows" : U"")
+				+ (algorithmOptions.orientations ? U" +Sym" : U"");
 
 		const String formatString =
 			U"Pattern: {}\n"		// 現在の抜き型
@@ -528,6 +612,7 @@ void Main() {
 			U"Prediction: {}%\n"	// マニュアルモードで現在の抜き型を適用した時の進度を先読み
 			U"Actual: {}\n"		    // カーソルがある位置の正しい要素
 			U"Step Size: {}\n"
+			U"Best: {}\n"			// 現在の抜き型・方向での最善手（位置と一致数）
 			U"{}"_fmt(
 			patterns[currentPattern].p,
 			patternPos.x, patternPos.y,
@@ -537,6 +622,7 @@ void Main() {
 			nextProgress,
 			actualValue,
 			answer.steps.size(),
+			bestMoves.isEmpty() ? String(U"-") : U"({},{}) {}"_fmt(bestMoves[0].first.x, bestMoves[0].first.y, bestMoves[0].second),
 			httpResponse
 			);
 
@@ -546,6 +632,7 @@ void Main() {
 		// 色見本表示
 		drawColorSample();
 		patternDraw(patterns, currentPattern, cellSize, patternPos, currentMode);
+		if (showBestMoves) bestMovesDraw(bestMoves, patterns[currentPattern], cellSize, currentMode);
 
 		// 不正なサイズ
 		// 問題が読み取れていない場合はサイズが１になる
@@ -569,4 +656,8 @@ void Main() {
 	{
 		task.wait();
 	}
+	if (bestMovesTask.isValid())
+	{
+		bestMovesTask.wait();
+	}
 }
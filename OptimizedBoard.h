@@ -0,0 +1,1134 @@
+﻿// OptimizedBoard.h
+// 探索用の盤面（OptimizedBoard）と、手・抜き型の索引などの小さな部品
+// Algorithm.cpp の探索と、盤面操作だけを測るマイクロベンチマーク（Headless/KernelBenchmark.cpp）から使う
+
+#pragma once
+#include "Core.h"
+#include "Pattern.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <vector>
+
+namespace Algorithm {
+
+	// 容量固定の小さな配列
+	// 探索中の候補手順をヒープ確保なしで保持するために使う
+	template <class T, size_t N>
+	class FixedVector {
+	public:
+		void push_back(const T& value) {
+			assert(m_size < N);
+			m_data[m_size++] = value;
+		}
+
+		template <class... Args>
+		T& emplace_back(Args&&... args) {
+			assert(m_size < N);
+			m_data[m_size] = T{ std::forward<Args>(args)... };
+			return m_data[m_size++];
+		}
+
+		void clear() { m_size = 0; }
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		T& operator[](size_t i) { return m_data[i]; }
+		const T& operator[](size_t i) const { return m_data[i]; }
+
+		T* begin() { return m_data.data(); }
+		T* end() { return m_data.data() + m_size; }
+		const T* begin() const { return m_data.data(); }
+		const T* end() const { return m_data.data() + m_size; }
+
+	private:
+		std::array<T, N> m_data{};
+		size_t m_size = 0;
+	};
+
+	// 探索用の1手
+	// `Solution` は抜き型を丸ごとコピーするので、探索中は抜き型の添字だけを持つ
+	struct Move {
+		int32 patternIndex = 0;
+		Point pos = Point(0, 0);
+		int32 direction = 0;
+	};
+
+	// 1候補分の手順（横移動1手 + 縦移動9手で最大10手）
+	using MoveList = FixedVector<Move, 16>;
+
+	// 候補点とその評価値
+	struct ScoredPoint {
+		int x, y;
+		float score;
+	};
+
+	// 候補探索用の使い回しバッファ
+	// 呼び出し側で1つ持っておき、毎回の確保を避ける
+	struct SearchBuffer {
+		std::vector<ScoredPoint> scored;
+		std::vector<std::pair<int, int>> points;
+	};
+
+	// 定型抜き型の最大サイズ 256 = 1 << 8
+	constexpr int MaxPatternBit = 8;
+	constexpr int MaxDisplacement = 1 << MaxPatternBit;
+
+	// 定型抜き型の数（1x1 + 2^1..2^8 の3タイプ）
+	constexpr int32 StandardPatternCount = 1 + 3 * MaxPatternBit;
+
+	// 2のべき乗の移動量 (1 << bit) に対応する定型抜き型（タイプⅠ）の添字
+	constexpr int powerOfTwoPatternIndex(int bit) {
+		return bit == 0 ? 0 : 3 * (bit - 1) + 1;
+	}
+
+	// 移動量 d を2のべき乗の和に分解したもの
+	// bits[0, count) に小さい順に bit が入り、count がそのまま手数になる
+	struct Decomposition {
+		int8 count = 0;
+		std::array<int8, MaxPatternBit + 1> bits{};
+	};
+
+	// 0 <= d <= 256 の分解表（コンパイル時に生成）
+	constexpr std::array<Decomposition, MaxDisplacement + 1> DecompositionTable = [] {
+		std::array<Decomposition, MaxDisplacement + 1> table{};
+		for (int d = 0; d <= MaxDisplacement; ++d) {
+			for (int bit = 0; bit <= MaxPatternBit; ++bit) {
+				if ((d >> bit) & 1) {
+					table[d].bits[table[d].count++] = static_cast<int8>(bit);
+				}
+			}
+		}
+		return table;
+	}();
+
+	static_assert(DecompositionTable[0].count == 0);
+	static_assert(DecompositionTable[255].count == 8);
+	static_assert(DecompositionTable[256].count == 1 && DecompositionTable[256].bits[0] == 8);
+
+	// 一般抜き型の索引（問題ごとに1回作る）
+	// 一般抜き型の1行（1列）にちょうど d マス続く 1 があれば、その行（列）だけで見ると d マスの横（縦）シフトが1手でできる
+	// (sx, sy) より前の揃ったマスを抜かないためには、続きの前の 1 が盤面の外に出る必要があるので、
+	// 置ける範囲を sx <= maxX, sy <= maxY として前計算しておく（盤面の左右の外に出る分は数えない控えめな見積もり）
+	class GeneralPatternIndex {
+	public:
+		// 1手のシフトに使える置き方
+		struct Placement {
+			int32 patternIndex;
+			// 抜き型の中で (sx, sy) に重ねるマス
+			Point anchor;
+			// 置ける (sx, sy) の上限
+			int32 maxX;
+			int32 maxY;
+		};
+
+		explicit GeneralPatternIndex(const Array<Pattern>& patterns) {
+			for (int32 i = StandardPatternCount; i < static_cast<int32>(patterns.size()); ++i) {
+				const Grid<int32>& grid = patterns[i].grid;
+				addHorizontalRuns(i, grid);
+				addVerticalRuns(i, grid);
+			}
+			for (int32 kind = 0; kind < 2; ++kind) {
+				for (int32 d = 0; d <= MaxDisplacement; ++d) {
+					if (!m_placements[kind][d].empty()) m_displacements[kind].push_back(d);
+				}
+			}
+		}
+
+		bool empty() const { return m_count == 0; }
+
+		// (sx, sy) から direction（0: 上, 2: 左）に1手で寄せられる移動量を列挙する
+		template <class Func>
+		void forEachShift(int32 direction, int32 sx, int32 sy, Func&& func) const {
+			const int32 kind = direction == 0 ? 0 : 1;
+			for (const int32 d : m_displacements[kind]) {
+				if (find(d, direction, sx, sy)) func(d);
+			}
+		}
+
+		// (sx, sy) から direction（0: 上, 2: 左）に d マス寄せる1手の置き方（なければ nullptr）
+		const Placement* find(int32 d, int32 direction, int32 sx, int32 sy) const {
+			if (m_count == 0 || d > MaxDisplacement) return nullptr;
+			for (const auto& placement : m_placements[direction == 0 ? 0 : 1][d]) {
+				if (sx <= placement.maxX && sy <= placement.maxY) return &placement;
+			}
+			return nullptr;
+		}
+
+	private:
+		static constexpr int32 Unbounded = std::numeric_limits<int32>::max();
+
+		// [0]: 上向き, [1]: 左向き。移動量ごとに、置ける範囲が他に含まれないものだけを持つ
+		std::array<std::array<std::vector<Placement>, MaxDisplacement + 1>, 2> m_placements;
+		// 置き方のある移動量（小さい順）
+		std::array<std::vector<int32>, 2> m_displacements;
+		size_t m_count = 0;
+
+		void add(int32 kind, int32 d, const Placement& placement) {
+			// 定型抜き型で1手のものは置き換えない
+			if (d > MaxDisplacement || DecompositionTable[d].count < 2) return;
+			auto& list = m_placements[kind][d];
+			for (const auto& other : list) {
+				if (placement.maxX <= other.maxX && placement.maxY <= other.maxY) return;
+			}
+			std::erase_if(list, [&](const Placement& other) {
+				return other.maxX <= placement.maxX && other.maxY <= placement.maxY;
+			});
+			list.push_back(placement);
+			++m_count;
+		}
+
+		// 左向き: 行 a の続き [c, end) の c から始めると end - c マス寄る
+		// 同じ行の c より前の 1 は盤面の左の外、a より上の行の 1 は盤面の上の外に出なければならない
+		void addHorizontalRuns(int32 patternIndex, const Grid<int32>& grid) {
+			const int32 w = static_cast<int32>(grid.width()), h = static_cast<int32>(grid.height());
+			int32 lastRowAbove = -1;
+			for (int32 a = 0; a < h; ++a) {
+				const int32 maxY = lastRowAbove < 0 ? Unbounded : a - lastRowAbove - 1;
+				int32 lastOne = -1;
+				for (int32 x = 0; x < w;) {
+					if (grid[a][x] != 1) { ++x; continue; }
+					int32 end = x;
+					while (end < w && grid[a][end] == 1) ++end;
+					for (int32 c = x; c < end; ++c) {
+						const int32 previous = c == x ? lastOne : c - 1;
+						const int32 maxX = previous < 0 ? Unbounded : c - previous - 1;
+						add(1, end - c, { patternIndex, Point(c, a), maxX, maxY });
+					}
+					lastOne = end - 1;
+					x = end;
+				}
+				if (lastOne >= 0) lastRowAbove = a;
+			}
+		}
+
+		// 上向き: 列 c の続き [a, end) の a から始めると end - a マス寄る
+		// (sx, sy) より前のマスを抜かないように、次の 1 は盤面の上の外に出なければならない
+		// - 同じ列の a より上の 1
+		// - 左の列の a 行目以上の 1（sy 行目の sx より左）
+		// - 右の列の a 行目より上の 1
+		void addVerticalRuns(int32 patternIndex, const Grid<int32>& grid) {
+			const int32 w = static_cast<int32>(grid.width()), h = static_cast<int32>(grid.height());
+			std::vector<int32> firstOne(h, w), lastOne(h, -1);
+			for (int32 y = 0; y < h; ++y) {
+				for (int32 x = 0; x < w; ++x) {
+					if (grid[y][x] == 1) {
+						firstOne[y] = Min(firstOne[y], x);
+						lastOne[y] = x;
+					}
+				}
+			}
+
+			for (int32 c = 0; c < w; ++c) {
+				int32 lastAbove = -1;
+				for (int32 y = 0; y < h;) {
+					if (grid[y][c] != 1) { ++y; continue; }
+					int32 end = y;
+					while (end < h && grid[end][c] == 1) ++end;
+					for (int32 a = y; a < end; ++a) {
+						int32 blocking = a == y ? lastAbove : a - 1;
+						for (int32 r = a; r > blocking; --r) {
+							if (firstOne[r] < c || (r < a && lastOne[r] > c)) {
+								blocking = r;
+								break;
+							}
+						}
+						const int32 maxY = blocking < 0 ? Unbounded : a - blocking - 1;
+						if (maxY >= 0) add(0, end - a, { patternIndex, Point(c, a), Unbounded, maxY });
+					}
+					lastAbove = end - 1;
+					y = end;
+				}
+			}
+		}
+	};
+
+	// 盤面サイズごとの手の組み立て
+	// 行の回り込みには盤面全体を覆う最小のタイプⅠを使う（256固定だと小さい盤面で無駄に広い）
+	struct MoveTable {
+		int32 width = 0;
+		int32 height = 0;
+		int32 coverBit = MaxPatternBit;
+		// 設定されていれば、定型抜き型で2手以上かかるシフトを一般抜き型の1手にする
+		const GeneralPatternIndex* general = nullptr;
+
+		constexpr MoveTable(int32 w, int32 h, const GeneralPatternIndex* generalPatterns = nullptr)
+			: width(w)
+			, height(h)
+			, coverBit(std::clamp(static_cast<int32>(std::bit_width(static_cast<uint32>(std::max(w, h) - 1))), 1, MaxPatternBit))
+			, general(generalPatterns && !generalPatterns->empty() ? generalPatterns : nullptr) {}
+
+		constexpr int32 coverSize() const { return 1 << coverBit; }
+
+		// 回り込み用（タイプⅠ）
+		constexpr int32 coverPatternIndex() const { return powerOfTwoPatternIndex(coverBit); }
+
+		// 1行おきに抜く（タイプⅡ）
+		constexpr int32 evenRowCoverPatternIndex() const { return powerOfTwoPatternIndex(coverBit) + 1; }
+
+		// (sx, sy) に (sx + dx, sy + dy) のマスを持ってくるのにかかる手数
+		// dy == 0 なら横シフトだけ、そうでなければ回り込み1手 + 縦シフト
+		static constexpr int32 relocationCost(int32 dx, int32 dy) {
+			if (dy == 0) return DecompositionTable[dx < 0 ? -dx : dx].count;
+			return (dx != 0 ? 1 : 0) + DecompositionTable[dy].count;
+		}
+
+		// pos から d だけ direction 方向に寄せる（小さい bit から順に）
+		void appendShifts(int32 d, const Point& pos, int32 direction, MoveList& moves) const {
+			if (general) {
+				if (const auto* placement = general->find(d, direction, pos.x, pos.y)) {
+					moves.push_back({ placement->patternIndex, Point(pos.x - placement->anchor.x, pos.y - placement->anchor.y), direction });
+					return;
+				}
+			}
+			const auto& decomposition = DecompositionTable[d];
+			for (int i = 0; i < decomposition.count; ++i) {
+				moves.push_back({ powerOfTwoPatternIndex(decomposition.bits[i]), pos, direction });
+			}
+		}
+
+		// row 以降の行を dx だけ左に回す（dx < 0 なら右に -dx）
+		void appendWrap(int32 dx, int32 row, MoveList& moves) const {
+			if (dx > 0) {
+				moves.push_back({ coverPatternIndex(), Point(dx - coverSize(), row), 2 });
+			}
+			else if (dx < 0) {
+				moves.push_back({ coverPatternIndex(), Point(dx + width, row), 3 });
+			}
+		}
+
+		// (sx, sy) に (sx + dx, sy + dy) のマスを持ってくる手順
+		// dy > 0 のときは wrapRow 以降を横に回してから縦に寄せる
+		void appendRelocation(int32 sx, int32 sy, int32 dx, int32 dy, int32 wrapRow, MoveList& moves) const {
+			if (dy == 0) {
+				appendShifts(dx, Point(sx, sy), 2, moves);
+				return;
+			}
+			appendWrap(dx, wrapRow, moves);
+			appendShifts(dy, Point(sx, sy), 0, moves);
+		}
+	};
+
+	class OptimizedBoard {
+	private:
+		// <summary>
+		// 盤面の1次元表現
+		// - `grid` : 現在の盤面データ
+		// - `goal` : ゴール盤面データ
+		// - `removed` : 抜き型で抜かれるマス（apply_pattern で使い回す、使い終わったら全部 false に戻す）
+		// - `lineBuffer` : 1行 / 1列を並べ直すときの作業領域
+		// </summary>
+		std::vector<uint64_t> grid;
+		std::vector<uint64_t> goal;
+		std::vector<bool> removed;
+		std::vector<uint8_t> lineBuffer;
+
+		// 先頭からこのマス数までは揃っていて、その後に変更されていないことが分かっている
+		// getCorrectCount* はここから先だけを調べる（変更があった行より後ろは markDirty で捨てる）
+		mutable int solvedCells = 0;
+
+		// 行ごとの値の出現ビットマスク
+		// valueMask[(y * 4 + v) * rowWords + i] の j bit目が立っている
+		// <=> 現在の盤面の (64 * i + j, y) の値が v
+		std::vector<uint64_t> valueMask;
+		int rowWords = 0;
+
+		// 最後に takeDirtyRows() してから値が変わった可能性のある行 [dirtyTop, dirtyBottom]
+		// 盤面の外側で持つ索引（SegmentIndex）の差分更新に使う
+		int dirtyTop = 0;
+		int dirtyBottom = -1;
+
+		void markDirty(int y) {
+			dirtyTop = Min(dirtyTop, y);
+			dirtyBottom = Max(dirtyBottom, y);
+			solvedCells = Min(solvedCells, y * width);
+		}
+
+		// 1次元 index のマスの読み書き（出現ビットマスクは呼び出し側で作り直す）
+		int readCell(int index) const {
+			return (grid[index / CELLS_PER_UINT64] >> ((index % CELLS_PER_UINT64) * 2)) & MASK;
+		}
+		void writeCell(int index, int value) {
+			const int bitIndex = (index % CELLS_PER_UINT64) * 2;
+			uint64_t& word = grid[index / CELLS_PER_UINT64];
+			word = (word & ~(MASK << bitIndex)) | (static_cast<uint64_t>(value) << bitIndex);
+		}
+
+		// 64bitに2bitごとに入れるので64/2 = 32bit
+		static constexpr int CELLS_PER_UINT64 = 32;
+
+		// 2bitごとに1次元に直すので"11"でandをとる
+		static constexpr uint64_t MASK = 0x3; // 11 in binary
+
+		// 座標変換
+		int calculateIndex(int x, int y) const {
+			return y * width + x;
+		}
+
+		// ポップカウント
+		int popcount(int n) const {
+			// return std::popcount(static_cast<unsigned>(n));
+			return std::popcount(static_cast<uint32_t>(n));
+			// return __builtin_popcount(n);
+		}
+
+		// Y座標変換
+		int getYFromIndex(int index) const {
+			return index / width;
+		}
+
+		// 1次元の index から32マス分（64bit）をまとめて取り出す
+		// 盤面の外は0で埋める
+		static uint64_t loadCells(const std::vector<uint64_t>& data, int index) {
+			int arrayIndex = index / CELLS_PER_UINT64;
+			int bitIndex = (index % CELLS_PER_UINT64) * 2;
+			uint64_t cells = arrayIndex < static_cast<int32>(data.size()) ? data[arrayIndex] >> bitIndex : 0;
+			if (bitIndex != 0 && arrayIndex + 1 < static_cast<int32>(data.size())) {
+				cells |= data[arrayIndex + 1] << (64 - bitIndex);
+			}
+			return cells;
+		}
+
+		// 2bitごとの偶数bitを下位32bitに詰める
+		static uint64_t compressEvenBits(uint64_t x) {
+			x &= 0x5555555555555555ULL;
+			x = (x | (x >> 1)) & 0x3333333333333333ULL;
+			x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+			x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+			x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+			x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+			return x;
+		}
+
+		// 索引の領域を確保
+		void initializeValueMask() {
+			rowWords = (width + 63) / 64;
+			valueMask.assign(static_cast<size_t>(height) * 4 * rowWords, 0);
+		}
+
+		// y行目の出現ビットマスクを作り直す
+		void rebuildValueMask(int y) {
+			markDirty(y);
+			uint64_t* masks = &valueMask[static_cast<size_t>(y) * 4 * rowWords];
+			std::fill(masks, masks + 4 * rowWords, 0);
+			for (int x = 0; x < width; x += CELLS_PER_UINT64) {
+				const int count = Min(CELLS_PER_UINT64, width - x);
+				const uint64_t valid = count == CELLS_PER_UINT64 ? ~0ULL : (1ULL << (count * 2)) - 1;
+				const uint64_t cells = loadCells(grid, y * width + x);
+				for (int v = 0; v < 4; ++v) {
+					// 各マスが v と一致していれば偶数bitが立つ
+					const uint64_t eq = ~(cells ^ (0x5555555555555555ULL * v)) & valid;
+					const uint64_t bits = compressEvenBits(eq & (eq >> 1));
+					masks[v * rowWords + x / 64] |= bits << (x % 64);
+				}
+			}
+		}
+
+		// 行の範囲 [y0, y1] の出現ビットマスクを作り直す
+		void rebuildValueMask(int y0, int y1) {
+			for (int y = Max(0, y0); y <= Min(height - 1, y1); ++y) {
+				rebuildValueMask(y);
+			}
+		}
+
+	public:
+		// サイズ
+		int width, height;
+
+		// 初期化
+		OptimizedBoard(int w, int h) : width(w), height(h) {
+			int cellCount = width * height;
+			int uint64Count = (cellCount + CELLS_PER_UINT64 - 1) / CELLS_PER_UINT64;
+			grid.resize(uint64Count, 0);
+			goal.resize(uint64Count, 0);
+			removed.resize(cellCount, false);
+			lineBuffer.resize(Max(width, height));
+			initializeValueMask();
+		}
+
+		OptimizedBoard(int w, int h, const Grid<int>& gr, const Grid<int>& go) :width(w), height(h) {
+			int cellCount = width * height;
+			int uint64Count = (cellCount + CELLS_PER_UINT64 - 1) / CELLS_PER_UINT64;
+			grid.resize(uint64Count, 0);
+			goal.resize(uint64Count, 0);
+			removed.resize(cellCount, false);
+			lineBuffer.resize(Max(width, height));
+			initializeValueMask();
+			setGrid(gr);
+			setGoal(go);
+		}
+
+		// 1行だけのボード
+		OptimizedBoard(int w, const std::vector<uint64_t>& gr, const std::vector<uint64_t>& go) :width(w), height(1) {
+			int cellCount = width * height;
+			int uint64Count = (cellCount + CELLS_PER_UINT64 - 1) / CELLS_PER_UINT64;
+			grid.resize(uint64Count, 0);
+			goal.resize(uint64Count, 0);
+			removed.resize(cellCount, false);
+			lineBuffer.resize(Max(width, height));
+			grid = gr;
+			goal = go;
+			initializeValueMask();
+			rebuildValueMask(0);
+		}
+
+		// 比較関数
+		bool operator==(const OptimizedBoard& other) const { return grid == other.grid; };
+
+		// 現在の盤面の個々の値を設定
+		void set(int x, int y, int value) {
+			int index = y * width + x;
+			int arrayIndex = index / CELLS_PER_UINT64;
+			int bitIndex = (index % CELLS_PER_UINT64) * 2;
+
+			uint64_t clearMask = ~(MASK << bitIndex);
+			const int oldValue = (grid[arrayIndex] >> bitIndex) & MASK;
+			grid[arrayIndex] = (grid[arrayIndex] & clearMask) |
+				(static_cast<uint64_t>(value) << bitIndex);
+
+			// 出現ビットマスクも更新
+			markDirty(y);
+			const uint64_t bit = 1ULL << (x % 64);
+			valueMask[(static_cast<size_t>(y) * 4 + oldValue) * rowWords + x / 64] &= ~bit;
+			valueMask[(static_cast<size_t>(y) * 4 + value) * rowWords + x / 64] |= bit;
+		}
+
+		// ゴール盤面の個々の値を設定
+		void _set(int x, int y, int value) {
+			int index = y * width + x;
+			int arrayIndex = index / CELLS_PER_UINT64;
+			int bitIndex = (index % CELLS_PER_UINT64) * 2;
+
+			uint64_t clearMask = ~(MASK << bitIndex);
+			goal[arrayIndex] = (goal[arrayIndex] & clearMask) |
+				(static_cast<uint64_t>(value) << bitIndex);
+			solvedCells = 0;
+		}
+
+		// 現在の盤面上の値を取得
+		int getGrid(int x, int y) const {
+			if (x >= width || y >= height)return -1;
+			int index = y * width + x;
+			int arrayIndex = index / CELLS_PER_UINT64;
+			int bitIndex = (index % CELLS_PER_UINT64) * 2;
+
+			return (grid[arrayIndex] >> bitIndex) & MASK;
+		}
+
+		// 前回からの変更行 [top, bottom] を返して記録を空にする（変更がなければ top > bottom）
+		std::pair<int, int> takeDirtyRows() {
+			const std::pair<int, int> rows{ dirtyTop, dirtyBottom };
+			dirtyTop = height;
+			dirtyBottom = -1;
+			return rows;
+		}
+
+		// y行目で値が value のマスのビットマスク（rowMaskWords() 個の uint64_t）
+		const uint64_t* getValueMask(int y, int value) const {
+			return &valueMask[(static_cast<size_t>(y) * 4 + value) * rowWords];
+		}
+
+		// 1行分のビットマスクの長さ
+		int rowMaskWords() const {
+			return rowWords;
+		}
+
+		// ゴール盤面上の値を取得
+		int getGoal(int x, int y) const {
+			if (x >= width || y >= height)return -1;
+			int index = y * width + x;
+			int arrayIndex = index / CELLS_PER_UINT64;
+			int bitIndex = (index % CELLS_PER_UINT64) * 2;
+
+			return (goal[arrayIndex] >> bitIndex) & MASK;
+		}
+
+		// 現在の盤面の詰めたデータ（スナップショット用）
+		const std::vector<uint64_t>& packedGrid() const {
+			return grid;
+		}
+
+		// ゴールの詰めたデータ
+		const std::vector<uint64_t>& packedGoal() const {
+			return goal;
+		}
+
+		// 盤面が確保しているメモリのバイト数
+		size_t memoryUsage() const {
+			return sizeof(OptimizedBoard)
+				+ (grid.capacity() + goal.capacity() + valueMask.capacity()) * sizeof(uint64_t)
+				+ removed.capacity() / 8 + lineBuffer.capacity();
+		}
+
+		// 1次元 index が begin 以降のマスのハッシュ（begin より前のマスは見ない）
+		uint64_t suffixHash(int begin) const {
+			constexpr uint64_t Multiplier = 0x9E3779B97F4A7C15ULL;
+			const int bitIndex = (begin % CELLS_PER_UINT64) * 2;
+			size_t i = begin / CELLS_PER_UINT64;
+			uint64_t hash = static_cast<uint64_t>(begin) * Multiplier;
+			if (i < grid.size()) {
+				hash = (hash ^ (grid[i] >> bitIndex)) * Multiplier;
+				hash ^= hash >> 29;
+			}
+			for (++i; i < grid.size(); ++i) {
+				hash = (hash ^ grid[i]) * Multiplier;
+				hash ^= hash >> 29;
+			}
+			return hash;
+		}
+
+		// スナップショットから現在の盤面を戻す（ゴールはそのまま）
+		// 値の変わった行だけを作り直し、その行だけを dirty にする
+		void restorePackedGrid(const std::vector<uint64_t>& packed) {
+			const auto first = std::mismatch(grid.begin(), grid.end(), packed.begin()).first;
+			if (first == grid.end()) return;
+			const int firstWord = static_cast<int>(first - grid.begin());
+			int lastWord = static_cast<int>(grid.size()) - 1;
+			while (grid[lastWord] == packed[lastWord]) --lastWord;
+			grid = packed;
+			rebuildValueMask(firstWord * CELLS_PER_UINT64 / width, (lastWord * CELLS_PER_UINT64 + CELLS_PER_UINT64 - 1) / width);
+		}
+
+		// グリッドを一度に設定
+		void setGrid(const Grid<int>& grid) {
+			for (int i : step(grid.height())) {
+				for (int j : step(grid.width())) {
+					set(j, i, grid[i][j]);
+				}
+			}
+		}
+
+		// ゴールを一度に設定
+		void setGoal(const Grid<int>& goal) {
+			for (int i : step(goal.height())) {
+				for (int j : step(goal.width())) {
+					_set(j, i, goal[i][j]);
+				}
+			}
+		}
+
+		// コンソールデバッグ用
+		void print() {
+			Grid<int> grid(width, height), goal(width, height);
+			for (int i = 0; i < height; i++) {
+				for (int j = 0; j < width; j++) {
+					grid[i][j] = getGrid(j, i);
+					goal[i][j] = getGoal(j, i);
+				}
+			}
+			Console << U"grid\n" << grid;
+			Console << U"goal\n" << goal;
+
+		}
+
+		// 上向き適用
+		// 1本の線（行または列）の [begin, end) を並べ直す
+		// 抜かれたマスは removedFirst なら先頭側に、そうでなければ末尾側にまとめる（それぞれ元の順のまま）
+		// cellIndex(i) は線上の i 番目のマスの1次元 index
+		template <class CellIndex>
+		void rearrangeLine(int begin, int end, bool removedFirst, CellIndex cellIndex) {
+			int count = 0;
+			for (const bool takeRemoved : { removedFirst, !removedFirst }) {
+				for (int i = begin; i < end; ++i) {
+					const int index = cellIndex(i);
+					if (removed[index] == takeRemoved) lineBuffer[count++] = static_cast<uint8_t>(readCell(index));
+				}
+			}
+			for (int i = begin; i < end; ++i) {
+				writeCell(cellIndex(i), lineBuffer[i - begin]);
+			}
+		}
+
+		// 抜かれるマスを囲む範囲 [left, right] x [top, bottom] の外は、動かないか位置が変わらない
+		// 上: 列 [left, right] の top 行目から下、下: 列 [left, right] の bottom 行目から上
+		// 左: 行 [top, bottom] の left 列目から右、右: 行 [top, bottom] の right 列目から左
+		// （それぞれ動く範囲を決める辺だけを受け取る）
+		void shift_up(int left, int right, int top) {
+			for (int x = left; x <= right; ++x) {
+				rearrangeLine(top, height, false, [&](int y) { return y * width + x; });
+			}
+
+			// 抜いた行より下の列が動く
+			rebuildValueMask(top, height - 1);
+		}
+		void shift_down(int left, int right, int bottom) {
+			for (int x = left; x <= right; ++x) {
+				rearrangeLine(0, bottom + 1, true, [&](int y) { return y * width + x; });
+			}
+
+			// 抜いた行より上の列が動く
+			rebuildValueMask(0, bottom);
+		}
+		void shift_left(int top, int bottom, int left) {
+			for (int y = top; y <= bottom; ++y) {
+				rearrangeLine(left, width, false, [&](int x) { return y * width + x; });
+			}
+
+			// 抜いた行だけが動く
+			rebuildValueMask(top, bottom);
+		}
+		void shift_right(int top, int bottom, int right) {
+			for (int y = top; y <= bottom; ++y) {
+				rearrangeLine(0, right + 1, true, [&](int x) { return y * width + x; });
+			}
+
+			// 抜いた行だけが動く
+			rebuildValueMask(top, bottom);
+		}
+
+		void apply_pattern(const Pattern& pattern, Point pos, int direction) {
+			PROFILE_ZONE("apply_pattern");
+			PROFILE_COUNT(OpsApplied, 1);
+			// 盤面に重なる部分だけを見る
+			const int patternTop = Max(0, -pos.y), patternBottom = Min(static_cast<int>(pattern.grid.height()), height - pos.y);
+			const int patternLeft = Max(0, -pos.x), patternRight = Min(static_cast<int>(pattern.grid.width()), width - pos.x);
+
+			// 抜かれるマスを囲む範囲
+			int left = width, right = -1, top = height, bottom = -1;
+			for (int y = patternTop; y < patternBottom; ++y) {
+				for (int x = patternLeft; x < patternRight; ++x) {
+					if (pattern.grid[y][x] == 1) {
+						const int bx = pos.x + x, by = pos.y + y;
+						removed[by * width + bx] = true;
+						left = Min(left, bx);
+						right = Max(right, bx);
+						top = Min(top, by);
+						bottom = Max(bottom, by);
+					}
+				}
+			}
+
+			// 盤面の外にしか当たらない場合は何も変わらない
+			if (bottom < 0) return;
+
+			switch (direction) {
+			case 0: // up
+				shift_up(left, right, top);
+				break;
+			case 1: // down
+				shift_down(left, right, bottom);
+				break;
+			case 2: // left
+				shift_left(top, bottom, left);
+				break;
+			case 3: // right
+				shift_right(top, bottom, right);
+				break;
+			}
+
+			// 印を付けた範囲だけ戻す
+			for (int y = top; y <= bottom; ++y) {
+				std::fill(removed.begin() + (y * width + left), removed.begin() + (y * width + right + 1), false);
+			}
+		}
+
+		// 2bitごとの差分を1マス1bit（偶数bit）にまとめる
+		// 値が異なるマスの位置にだけbitが立つ
+		static uint64_t mismatchBits(uint64_t a, uint64_t b) {
+			const uint64_t diff = a ^ b;
+			return (diff | (diff >> 1)) & 0x5555555555555555ULL;
+		}
+
+		// 先頭 count マス分の偶数bitのマスク
+		static uint64_t cellMask(int count) {
+			return count >= CELLS_PER_UINT64 ? 0x5555555555555555ULL : 0x5555555555555555ULL & ((1ULL << (count * 2)) - 1);
+		}
+
+		// 値が v のマスの位置に偶数bitが立つ
+		static uint64_t equalBits(uint64_t cells, int v) {
+			return ~mismatchBits(cells, 0x5555555555555555ULL * v) & 0x5555555555555555ULL;
+		}
+
+		// 32列分の個数を縦に持つカウンタ（k 枚目が各列の個数の k bit目）
+		// 盤面の高さは 65535 以下とする
+		using ColumnCounter = std::array<uint64_t, 16>;
+
+		// bits の立っている列の個数を1増やす
+		static void addColumnBits(ColumnCounter& counter, uint64_t bits) {
+			for (size_t k = 0; k < counter.size() && bits != 0; ++k) {
+				const uint64_t carry = counter[k] & bits;
+				counter[k] ^= bits;
+				bits = carry;
+			}
+		}
+
+		// ゴールの goalIndex からと現在の盤面の gridIndex から、何マス連続で一致しているか（最大 length マス）
+		// index は y * width + x の1次元座標で、行をまたいでそのまま続く
+		int matchLength(int goalIndex, int gridIndex, int length) const {
+			int matched = 0;
+			while (matched < length) {
+				const int count = Min(CELLS_PER_UINT64, length - matched);
+				const uint64_t diff = mismatchBits(loadCells(goal, goalIndex + matched), loadCells(grid, gridIndex + matched)) & cellMask(count);
+				if (diff != 0) {
+					return matched + std::countr_zero(diff) / 2;
+				}
+				matched += count;
+			}
+			return length;
+		}
+
+		// matchLength の現在の盤面側を (gridX, gridY) から始まる1行に限ったもの
+		// wrap なら行の終わりで同じ行の先頭に戻る（最大 width マス）
+		int matchLengthInRow(int goalIndex, int gridX, int gridY, int length, bool wrap) const {
+			const int first = Min(length, width - gridX);
+			const int matched = matchLength(goalIndex, gridY * width + gridX, first);
+			if (matched < first || !wrap) {
+				return matched;
+			}
+			return first + matchLength(goalIndex + first, gridY * width, Min(length - first, gridX));
+		}
+
+		// ゴールの goalIndex からと現在の盤面の gridIndex からの length マスで、値が一致しているマスの数
+		int equalCount(int goalIndex, int gridIndex, int length) const {
+			int count = 0;
+			for (int offset = 0; offset < length; offset += CELLS_PER_UINT64) {
+				const uint64_t mask = cellMask(length - offset);
+				const uint64_t diff = mismatchBits(loadCells(goal, goalIndex + offset), loadCells(grid, gridIndex + offset));
+				count += std::popcount(~diff & mask);
+			}
+			return count;
+		}
+
+		// 盤面すべての揃っている個数のカウント
+		int getCorrectCountAll() const {
+			return solvedCells + equalCount(solvedCells, solvedCells, width * height - solvedCells);
+		}
+
+		// 何マスまで揃っているかのカウント
+		int getCorrectCount() const {
+			int totalCells = width * height;
+			int uint64Count = (totalCells + CELLS_PER_UINT64 - 1) / CELLS_PER_UINT64;
+
+			// 揃っていると分かっている所は飛ばす
+			for (int i = solvedCells / CELLS_PER_UINT64; i < uint64Count; ++i) {
+				const uint64_t diff = mismatchBits(grid[i], goal[i]);
+				if (diff != 0) {
+					solvedCells = Min(totalCells, i * CELLS_PER_UINT64 + std::countr_zero(diff) / 2);
+					return solvedCells;
+				}
+			}
+			solvedCells = totalCells;
+			return totalCells;
+		}
+
+		//　任意の点から何マスまで揃っているか
+		// 盤面の最後まで揃っていたら先頭に戻って数える
+		int getCorrectCountFrom(int startX, int startY) const {
+			int totalCells = width * height;
+			int startIndex = startY * width + startX;
+
+			const int count = matchLength(startIndex, startIndex, totalCells - startIndex);
+			if (count < totalCells - startIndex) {
+				return count;
+			}
+			return count + matchLength(0, 0, startIndex);
+		}
+
+		//　任意の行が何個揃っているか
+		int getCorrectCountByRrow(int row)const {
+			return equalCount(row * width, row * width, width);
+		}
+
+		// y行目で値が value のマスの x 座標 (>= fromX) を小さい順に列挙する
+		template <class Func>
+		void forEachCellWithValue(int y, int value, int fromX, Func&& func) const {
+			const uint64_t* mask = getValueMask(y, value);
+			for (int i = fromX / 64; i < rowWords; ++i) {
+				uint64_t bits = mask[i];
+				if (i == fromX / 64) bits &= ~0ULL << (fromX % 64);
+				while (bits) {
+					func(i * 64 + std::countr_zero(bits));
+					bits &= bits - 1;
+				}
+			}
+		}
+
+		// 任意のマス(x, y) = (a, b)と同じ値のマスで最も近い点
+		Point findClosestPointWithSameValue(int a, int b) const {
+			int targetValue = getGoal(a, b);
+			int minPopcountDiff = std::numeric_limits<int>::max();
+			Point closestPoint = { -1, -1 };
+
+			// popcount 差は行ごとに決まるので、各行で最初に見つかった点だけを見る
+			for (int y = b; y < height; ++y) {
+				int popcountDiff = popcount(y - b);
+				if (popcountDiff >= minPopcountDiff) continue;
+				forEachCellWithValue(y, targetValue, a, [&](int x) {
+					if (popcountDiff < minPopcountDiff) {
+						minPopcountDiff = popcountDiff;
+						closestPoint = { x,y };
+					}
+				});
+			}
+			return closestPoint;
+		}
+
+		// 任意のマス(x, y) = (a, b)と同じ値のマス
+		// 結果は buffer.points に入る
+		const std::vector<std::pair<int, int>>& findPointsWithSameValue(int a, int b, SearchBuffer& buffer) const {
+			int target = getGoal(a, b);
+			auto& result = buffer.points;
+			result.clear();
+			for (int y = b; y < height; y++) {
+				forEachCellWithValue(y, target, a, [&](int x) {
+					result.emplace_back(x, y);
+				});
+			}
+			return result;
+		}
+
+		// 任意のマス(x, y) = (a, b)と同じ値のマスをpopcountでソート
+		const std::vector<std::pair<int, int>>& sortedFindPointsWithSameValue(int a, int b, SearchBuffer& buffer) const {
+			const int targetValue = getGoal(a, b);
+			auto& result = buffer.points;
+			result.clear();
+			for (int y = b; y < height; y++) {
+				forEachCellWithValue(y, targetValue, a, [&](int x) {
+					result.emplace_back(x, y);
+				});
+			}
+			return result;
+		}
+
+		// 任意のマス(x, y) = (a, b)と同じ値かつY軸のポップカウントが1の点
+		const std::vector<std::pair<int, int>>& findPointsWithSameValueAndYPopcountDiff1(int a, int b, SearchBuffer& buffer) const {
+			const int targetValue = getGoal(a, b);
+			const int nextValue = getGoal(a + 1, b);
+			auto& result = buffer.points;
+			result.clear();
+
+			for (const int dy : {1, 2, 4, 8, 16, 32, 64}) {
+				int ny = b + dy;
+				if (ny >= height) continue;
+				forEachCellWithValue(ny, targetValue, 0, [&](int x) {
+					if (a == width - 1 || getGrid((x + 1) % width, ny) == nextValue) {
+						result.emplace_back(x, ny);
+					}
+				});
+			}
+
+			return result;
+		}
+
+		// 任意のマス(x, y) = (a, b)と同じ値かつY軸のポップカウントが1の点を期待値の高い順にソート
+		// 走査したい行を指定できる
+		// popcount(specificY - b) == 1である必要がある
+		// 結果は buffer.points に入る（buffer.scored は作業用）
+		// general があれば、一般抜き型1手で寄せられる移動量の点も候補に加える
+		const std::vector<std::pair<int, int>>& sortedFindPointsWithSameValueAndYPopcountDiff1(int a, int b, SearchBuffer& buffer, int specificY = -1, const GeneralPatternIndex* general = nullptr) const {
+			int targetValue = getGoal(a, b);
+			auto& result = buffer.scored; // (x, y, count)
+			result.clear();
+
+			auto calculateCount = [&](int sx, int sy, int nx, int ny) {
+				int dy = ny - sy;
+				if (dy == 0) {
+					const int matched = matchLength(sy * width + nx, ny * width + nx, width - nx);
+					return matched < width - nx ? nx + matched : nx - sx;
+				}
+				// ゴール側は行末で打ち切り、現在の盤面側は行の先頭に戻って比べる
+				const int matched = matchLengthInRow(sy * width + sx, nx, ny, Min(dy, width - sx), true);
+				if (matched < dy) return matched;
+				int progress = sx + dy + sy * width;
+				sx = progress % width; sy = progress / width;
+				return dy + getCorrectCountFrom(sx, sy);
+			};
+
+			if (specificY == -1) {
+				for (const int dy : {1, 2, 4, 8, 16, 32, 64}) {
+					int ny = b + dy;
+					if (ny >= height) break;
+					forEachCellWithValue(ny, targetValue, 0, [&](int x) {
+						int count = calculateCount(a, b, x, ny);
+						int stepSize = MoveTable::relocationCost(x - a, ny - b);
+						result.push_back({ x, ny, static_cast<float>(count / stepSize) });
+					});
+				}
+				if (general) {
+					// 一般抜き型の候補は、定型抜き型の候補の最高評価を上回るときだけ加える（同点なら定型抜き型で足りる）
+					// calculateCount は dy マス揃わなければ dy 未満、揃えば dy + (寄せた先から揃っている数) なので、
+					// 後者を上限として、届かない移動量は行を走査する前に捨てる。真上 (x == a) は1手、それ以外は2手かかる
+					float standardBest = -1;
+					for (const auto& candidate : result) {
+						standardBest = Max(standardBest, candidate.score);
+					}
+					float bestScore = standardBest;
+					general->forEachShift(0, a, b, [&](int dy) {
+						int ny = b + dy;
+						if (ny >= height) return;
+						const int bound = dy <= width - a ? dy + getCorrectCountFrom((a + dy) % width, b + (a + dy) / width) : width - a;
+						if (bound <= standardBest || bound < bestScore) return;
+						auto probe = [&](int x) {
+							int count = calculateCount(a, b, x, ny);
+							int stepSize = (x != a ? 1 : 0) + 1;
+							const float score = static_cast<float>(count / stepSize);
+							if (score <= standardBest) return;
+							bestScore = Max(bestScore, score);
+							result.push_back({ x, ny, score });
+						};
+						if (bound / 2 <= standardBest || bound / 2 < bestScore) {
+							if (getGrid(a, ny) == targetValue) probe(a);
+							return;
+						}
+						forEachCellWithValue(ny, targetValue, 0, probe);
+					});
+				}
+			}
+			else if (specificY == b) {
+				// popcount(dx) = 1である必要がある
+				for (int dx : {1, 2, 4, 8, 16, 32, 64, 128}) {
+					if (a + dx >= width) break;
+					if (getGrid(a + dx, b) == targetValue) {
+						int count = calculateCount(a, b, a + dx, b);
+						result.push_back({ a + dx, b, static_cast<float>(count) });
+					}
+				}
+			}
+			else {
+				int ny = specificY;
+				for (int dx : {1, 2, 4, 8, 16, 32, 64, 128}) {
+					int x = a + dx;
+					if (x >= width) break;
+					if (getGrid(x, ny) == targetValue) {
+						int count = calculateCount(a, b, x, ny);
+						int stepSize = MoveTable::relocationCost(x - a, ny - b);
+						result.push_back({ x, ny, static_cast<float>(count / stepSize) });
+					}
+				}
+			}
+
+			// 最大値と同じ評価の点だけを残すので、全体のソートはしない
+			float maxCount = -1;
+			for (const auto& candidate : result) {
+				maxCount = Max(maxCount, candidate.score);
+			}
+
+			auto& sortedResult = buffer.points;
+			sortedResult.clear();
+			for (const auto& [x, y, count] : result) {
+				if (count < maxCount) continue;
+				sortedResult.emplace_back(x, y);
+			}
+
+			// dy = 0のとき
+			for (int dx : {1, 2, 4, 8, 16, 32, 64, 128}) {
+				if (a + dx >= width) break;
+				if (getGrid(a + dx, b) == targetValue) {
+					sortedResult.emplace_back(a + dx, b);
+				}
+			}
+			if (general) {
+				general->forEachShift(2, a, b, [&](int dx) {
+					if (a + dx < width && getGrid(a + dx, b) == targetValue) {
+						sortedResult.emplace_back(a + dx, b);
+					}
+				});
+			}
+
+			return sortedResult;
+		}
+
+		// 任意のマス(x, y) = (a, b)と同じ値のマスで、同じ行にあるものを探す
+		// (a, b) より右にあるもの
+		const std::vector<std::pair<int, int>>& findPointsWithSameValueInSameRow(int a, int b, SearchBuffer& buffer) const {
+			auto& result = buffer.points;
+			result.clear();
+			int targetValue = getGoal(a, b);
+			forEachCellWithValue(b, targetValue, a + 1, [&](int x) {
+				result.emplace_back(x, b);
+			});
+			return result;
+		}
+
+		// 異なる二つの行でどれだけ連続して揃っているか
+		// (sx, sy) ゴール盤面の始点
+		// (nx, ny) 現在の盤面の始点
+		int calculateSuccessiveArea(int sx, int sy, int nx, int ny) const {
+			return matchLength(sy * width + sx, ny * width + nx, Min(width - sx, width - nx));
+		}
+
+		// 異なる二つの行でどれだけ揃っているか
+		// (sx, sy) ゴール盤面の始点
+		// (nx, ny) 現在の盤面の始点
+		// 短い方の行末までを比べる
+		int compareRows(int sx, int sy, int nx, int ny) const {
+			if (ny >= height) return 0;
+			return equalCount(sy * width + sx, ny * width + nx, Min(width - sx, width - nx));
+		}
+
+		// 特定の行を抜き出す
+		OptimizedBoard extractRow(int goalRow, int currentRow) const {
+			if (currentRow < 0 || currentRow >= height || goalRow < 0 || goalRow >= height) {
+				throw std::out_of_range("Invalid row index");
+			}
+
+			OptimizedBoard newBoard(width, 1);
+			for (int x = 0; x < width; ++x) {
+				newBoard.set(x, 0, getGrid(x, currentRow));
+				newBoard._set(x, 0, getGoal(x, goalRow));
+			}
+			return newBoard;
+		}
+
+		// 正解かどうか
+		bool isGoal()const {
+			// Console << getCorrectCountAll();
+			return getCorrectCount() == width * height;
+		}
+
+		// 残り手数の下界（許容的: 実際の手数がこれを下回ることはない）
+		// 左右の移動は各行の値の個数を、上下の移動は各列の値の個数を変えないので
+		// - 行ごとの個数がゴールと違う行があれば上下の移動が最低1手
+		// - 列ごとの個数がゴールと違う列があれば左右の移動が最低1手
+		// - 個数が全部合っていても一致していなければ最低1手
+		// 1手で全マスが動きうるので、これ以上の下界は安く求まらない（最大2）
+		int32 remainingStepsLowerBound() const {
+			if (isGoal()) return 0;
+
+			// 行ごとの個数: 現在の盤面は出現ビットマスクの popcount、ゴールは32マスずつまとめて数える
+			bool rowDiffers = false;
+			for (int y = 0; y < height && !rowDiffers; ++y) {
+				std::array<int32, 4> counts{};
+				for (int v = 0; v < 4; ++v) {
+					const uint64_t* masks = getValueMask(y, v);
+					for (int i = 0; i < rowWords; ++i) counts[v] += std::popcount(masks[i]);
+				}
+				for (int x = 0; x < width; x += CELLS_PER_UINT64) {
+					const uint64_t cells = loadCells(goal, y * width + x);
+					const uint64_t mask = cellMask(width - x);
+					for (int v = 0; v < 4; ++v) counts[v] -= std::popcount(equalBits(cells, v) & mask);
+				}
+				rowDiffers = counts != std::array<int32, 4>{};
+			}
+
+			// 列ごとの個数: 32列ずつ、各列の個数を縦に足し込む（ビットスライスのカウンタ）
+			bool columnDiffers = false;
+			for (int x = 0; x < width && !columnDiffers; x += CELLS_PER_UINT64) {
+				const uint64_t mask = cellMask(width - x);
+				std::array<ColumnCounter, 4> gridCounts{}, goalCounts{};
+				for (int y = 0; y < height; ++y) {
+					const uint64_t gridCells = loadCells(grid, y * width + x);
+					const uint64_t goalCells = loadCells(goal, y * width + x);
+					for (int v = 0; v < 4; ++v) {
+						addColumnBits(gridCounts[v], equalBits(gridCells, v) & mask);
+						addColumnBits(goalCounts[v], equalBits(goalCells, v) & mask);
+					}
+				}
+				columnDiffers = gridCounts != goalCounts;
+			}
+
+			return Max(1, int32(rowDiffers) + int32(columnDiffers));
+		}
+
+		// 今の手数 steps から続けて stepLimit 手未満でゴールできる見込みがあるか
+		// 下界は最大2なので、上限の2手手前まで来た試行を打ち切ることにしか使えない（探索木を減らすものではない）
+		// 余裕があるうちは盤面を調べない
+		bool canFinishWithin(size_t steps, size_t stepLimit) const {
+			if (steps + 2 < stepLimit) return true;
+			return steps + remainingStepsLowerBound() < stepLimit;
+		}
+
+	};
+}
@@ -48,6 +48,26 @@ public:
 		return Pattern(grid, p, name);
 	}
 
+	// JSONに書き出す（fromJSON で読める、行ごとの文字列の形式）
+	JSON toJSON() const {
+		Array<String> cells;
+		for (int32 y = 0; y < static_cast<int32>(grid.height()); ++y) {
+			String row;
+			for (int32 x = 0; x < static_cast<int32>(grid.width()); ++x) {
+				row.push_back(static_cast<char32_t>(U'0' + grid[y][x]));
+			}
+			cells << row;
+		}
+
+		JSON json;
+		json[U"p"] = p;
+		json[U"width"] = static_cast<int32>(grid.width());
+		json[U"height"] = static_cast<int32>(grid.height());
+		json[U"cells"] = cells;
+		return json;
+	}
+
+#ifndef PROCON_HEADLESS
 	// siv3d用の描画
 	void draw(const Point& pos, int32 cellSize, const ColorF& color = Palette::Red) const {
 		for (int32 y = 0; y < grid.height(); ++y) {
@@ -59,4 +79,5 @@ public:
 			}
 		}
 	}
+#endif
 };
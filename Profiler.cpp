@@ -0,0 +1,203 @@
+﻿// Profiler.cpp
+
+#include "Profiler.h"
+
+#ifdef PROCON_PROFILE
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace Profiler {
+
+	namespace {
+		constexpr std::array<const char*, static_cast<size_t>(Counter::Count)> CounterNames = {
+			"opsApplied", "candidatesGenerated", "statesExpanded", "cacheLookups", "cacheHits",
+		};
+
+		// 1スレッドがトレースに残すイベントの上限（超えた分は集計だけ）
+		constexpr size_t MaxEventsPerThread = size_t(1) << 20;
+
+		// 全スレッドの記録。終了時（静的オブジェクトの破棄）に書き出す
+		class Registry {
+		public:
+			Registry()
+				: m_start(std::chrono::steady_clock::now()) {
+				const char* minMicroseconds = std::getenv("PROCON_TRACE_MIN_US");
+				m_minDuration = minMicroseconds ? std::llround(std::atof(minMicroseconds) * 1000) : 20000;
+				const char* path = std::getenv("PROCON_TRACE");
+				m_path = path && *path ? path : "procon_trace.json";
+			}
+
+			~Registry() {
+				std::lock_guard lock(m_mutex);
+				writeTrace();
+				printSummary();
+			}
+
+			int32_t registerZone(const char* name) {
+				std::lock_guard lock(m_mutex);
+				if (m_zoneNames.size() >= static_cast<size_t>(MaxZones)) {
+					std::fprintf(stderr, "[profile] too many zones, %s is merged into %s\n", name, m_zoneNames.back());
+					return MaxZones - 1;
+				}
+				m_zoneNames.push_back(name);
+				return static_cast<int32_t>(m_zoneNames.size() - 1);
+			}
+
+			ThreadLog* createThreadLog() {
+				std::lock_guard lock(m_mutex);
+				auto& log = m_logs.emplace_back(std::make_unique<ThreadLog>());
+				log->thread = static_cast<int32_t>(m_logs.size());
+				return log.get();
+			}
+
+			int64_t now() const {
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+			}
+
+			int64_t minDuration() const {
+				return m_minDuration;
+			}
+
+		private:
+			void writeTrace() const {
+				std::FILE* out = std::fopen(m_path.c_str(), "w");
+				if (!out) {
+					std::fprintf(stderr, "[profile] cannot write %s\n", m_path.c_str());
+					return;
+				}
+
+				const int64_t end = now();
+				bool first = true;
+				auto separator = [&]() {
+					std::fputs(first ? "\n" : ",\n", out);
+					first = false;
+				};
+
+				std::fputs("{\"traceEvents\":[", out);
+				for (const auto& log : m_logs) {
+					separator();
+					std::fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", log->thread, log->thread);
+					for (const auto& event : log->events) {
+						separator();
+						std::fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+							m_zoneNames[event.zone], log->thread, event.start / 1000.0, event.duration / 1000.0);
+					}
+					separator();
+					std::fprintf(out, "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{", log->thread, end / 1000.0);
+					for (size_t i = 0; i < CounterNames.size(); ++i) {
+						std::fprintf(out, "%s\"%s\":%lld", i ? "," : "", CounterNames[i], static_cast<long long>(log->counters[i]));
+					}
+					std::fputs("}}", out);
+				}
+
+				const auto zones = zoneTotals();
+				const auto counters = counterTotals();
+				std::fprintf(out, "\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"minDurationUs\":%.3f,\"droppedEvents\":%lld,\"zones\":{",
+					m_minDuration / 1000.0, static_cast<long long>(droppedEvents()));
+				for (size_t i = 0; i < m_zoneNames.size(); ++i) {
+					std::fprintf(out, "%s\"%s\":{\"count\":%lld,\"totalMs\":%.3f}", i ? "," : "", m_zoneNames[i],
+						static_cast<long long>(zones[i].count), zones[i].nanoseconds / 1e6);
+				}
+				std::fputs("},\"counters\":{", out);
+				for (size_t i = 0; i < CounterNames.size(); ++i) {
+					std::fprintf(out, "%s\"%s\":%lld", i ? "," : "", CounterNames[i], static_cast<long long>(counters[i]));
+				}
+				std::fprintf(out, "},\"cacheHitRate\":%.6f}}\n", cacheHitRate(counters));
+				std::fclose(out);
+			}
+
+			void printSummary() const {
+				const auto zones = zoneTotals();
+				const auto counters = counterTotals();
+				std::fprintf(stderr, "[profile] %-32s %12s %12s %10s\n", "zone", "count", "total ms", "mean us");
+				for (size_t i = 0; i < m_zoneNames.size(); ++i) {
+					if (zones[i].count == 0) continue;
+					std::fprintf(stderr, "[profile] %-32s %12lld %12.1f %10.2f\n", m_zoneNames[i], static_cast<long long>(zones[i].count),
+						zones[i].nanoseconds / 1e6, zones[i].nanoseconds / 1e3 / zones[i].count);
+				}
+				for (size_t i = 0; i < CounterNames.size(); ++i) {
+					std::fprintf(stderr, "[profile] %-32s %12lld\n", CounterNames[i], static_cast<long long>(counters[i]));
+				}
+				std::fprintf(stderr, "[profile] %-32s %11.1f%%\n", "cache hit rate", cacheHitRate(counters) * 100);
+				std::fprintf(stderr, "[profile] trace: %s (%lld threads, %lld events dropped)\n", m_path.c_str(),
+					static_cast<long long>(m_logs.size()), static_cast<long long>(droppedEvents()));
+			}
+
+			std::array<ZoneTotal, MaxZones> zoneTotals() const {
+				std::array<ZoneTotal, MaxZones> totals{};
+				for (const auto& log : m_logs) {
+					for (int32_t i = 0; i < MaxZones; ++i) {
+						totals[i].count += log->zones[i].count;
+						totals[i].nanoseconds += log->zones[i].nanoseconds;
+					}
+				}
+				return totals;
+			}
+
+			std::array<int64_t, static_cast<size_t>(Counter::Count)> counterTotals() const {
+				std::array<int64_t, static_cast<size_t>(Counter::Count)> totals{};
+				for (const auto& log : m_logs) {
+					for (size_t i = 0; i < totals.size(); ++i) {
+						totals[i] += log->counters[i];
+					}
+				}
+				return totals;
+			}
+
+			static double cacheHitRate(const std::array<int64_t, static_cast<size_t>(Counter::Count)>& counters) {
+				const int64_t lookups = counters[static_cast<size_t>(Counter::CacheLookups)];
+				return lookups > 0 ? double(counters[static_cast<size_t>(Counter::CacheHits)]) / lookups : 0.0;
+			}
+
+			int64_t droppedEvents() const {
+				int64_t dropped = 0;
+				for (const auto& log : m_logs) dropped += log->droppedEvents;
+				return dropped;
+			}
+
+			const std::chrono::steady_clock::time_point m_start;
+			int64_t m_minDuration = 0;
+			std::string m_path;
+			mutable std::mutex m_mutex;
+			std::vector<const char*> m_zoneNames;
+			std::vector<std::unique_ptr<ThreadLog>> m_logs;
+		};
+
+		Registry& registry() {
+			static Registry instance;
+			return instance;
+		}
+	}
+
+	int32_t registerZone(const char* name) {
+		return registry().registerZone(name);
+	}
+
+	int64_t now() {
+		return registry().now();
+	}
+
+	ThreadLog* createThreadLog() {
+		return registry().createThreadLog();
+	}
+
+	void record(int32_t zone, int64_t start, int64_t end) {
+		ThreadLog& log = threadLog();
+		const int64_t duration = end - start;
+		log.zones[zone].count += 1;
+		log.zones[zone].nanoseconds += duration;
+		if (duration < registry().minDuration()) return;
+		if (log.events.size() >= MaxEventsPerThread) {
+			++log.droppedEvents;
+			return;
+		}
+		log.events.push_back({ zone, start, duration });
+	}
+}
+
+#endif
@@ -0,0 +1,111 @@
+﻿#pragma once
+// Profiler.h
+// 探索の中の計測（区間の時間とスレッドごとのカウンタ）
+// PROCON_PROFILE を定義したビルドだけで有効になり、定義しなければマクロは何も生成しない
+//
+//   PROFILE_ZONE("greedy");                  // この行からスコープの終わりまでを1区間として測る
+//   PROFILE_COUNT(OpsApplied, 1);            // カウンタに足す
+//
+// 終了時に Chrome のトレース（chrome://tracing や Perfetto で開ける JSON）を書き出し、区間とカウンタの集計を標準エラーに出す
+// 出力先は環境変数 PROCON_TRACE（既定 procon_trace.json）
+// 区間は毎回集計し、トレースには PROCON_TRACE_MIN_US マイクロ秒（既定 20）以上のものだけを残す
+
+#ifdef PROCON_PROFILE
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace Profiler {
+
+	enum class Counter {
+		// 盤面に適用した抜き型の数
+		OpsApplied,
+		// 作った候補手順の数
+		CandidatesGenerated,
+		// 次の状態を調べた状態の数（ビームの状態、貪欲の1手）
+		StatesExpanded,
+		// 行の手順の記録を引いた回数・当たった回数
+		CacheLookups,
+		CacheHits,
+		Count,
+	};
+
+	// 区間の種類の上限
+	constexpr int32_t MaxZones = 64;
+
+	struct ZoneTotal {
+		int64_t count = 0;
+		int64_t nanoseconds = 0;
+	};
+
+	struct Event {
+		int32_t zone;
+		int64_t start;
+		int64_t duration;
+	};
+
+	// スレッドごとの記録（そのスレッドだけが書く）
+	struct ThreadLog {
+		int32_t thread = 0;
+		std::array<int64_t, static_cast<size_t>(Counter::Count)> counters{};
+		std::array<ZoneTotal, MaxZones> zones{};
+		std::vector<Event> events;
+		int64_t droppedEvents = 0;
+	};
+
+	// 区間の名前を登録して番号を返す（区間ごとに1回だけ呼ばれる）
+	int32_t registerZone(const char* name);
+
+	// 計測開始からの時刻（ナノ秒）
+	int64_t now();
+
+	ThreadLog* createThreadLog();
+
+	inline thread_local ThreadLog* CurrentThreadLog = nullptr;
+
+	inline ThreadLog& threadLog() {
+		if (!CurrentThreadLog) CurrentThreadLog = createThreadLog();
+		return *CurrentThreadLog;
+	}
+
+	void record(int32_t zone, int64_t start, int64_t end);
+
+	inline void add(Counter counter, int64_t amount) {
+		threadLog().counters[static_cast<size_t>(counter)] += amount;
+	}
+
+	// スコープの間を測る
+	class Zone {
+	public:
+		explicit Zone(int32_t zone)
+			: m_zone(zone)
+			, m_start(now()) {}
+
+		~Zone() {
+			record(m_zone, m_start, now());
+		}
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		int32_t m_zone;
+		int64_t m_start;
+	};
+}
+
+#define PROCON_PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROCON_PROFILE_CONCAT(a, b) PROCON_PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) \
+	static const int32_t PROCON_PROFILE_CONCAT(profileZoneId, __LINE__) = Profiler::registerZone(name); \
+	const Profiler::Zone PROCON_PROFILE_CONCAT(profileZone, __LINE__)(PROCON_PROFILE_CONCAT(profileZoneId, __LINE__))
+#define PROFILE_COUNT(counter, amount) Profiler::add(Profiler::Counter::counter, static_cast<int64_t>(amount))
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_COUNT(counter, amount) ((void)0)
+
+#endif